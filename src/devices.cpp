@@ -0,0 +1,258 @@
+/**
+ * @file devices.cpp
+ * @details A lookup first tries the path remembered in the cache file and
+ *          checks it with one open and one ioctl; only when that fails is
+ *          the directory scanned. inotify reports nodes that appear, get
+ *          their permissions from udev or disappear, so the caller can
+ *          reopen a device without restarting.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <linux/fb.h>
+#include <linux/input.h>
+#include "devices.h"
+
+#define DEVICE_WATCH_MASK (IN_CREATE | IN_ATTRIB | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM)
+
+static bool probe_framebuffer(int fd, const char *name)
+{
+    struct fb_fix_screeninfo fix_info;
+
+    if (ioctl(fd, FBIOGET_FSCREENINFO, &fix_info) < 0) { return false; }
+    return strncmp(name, fix_info.id, sizeof(fix_info.id)) == 0;
+}
+
+static bool probe_input(int fd, const char *name)
+{
+    char found[DEVICE_NAME_SZ];
+
+    if (ioctl(fd, EVIOCGNAME(sizeof(found)), found) < 0) { return false; }
+    found[sizeof(found) - 1] = 0;
+    return strcmp(name, found) == 0;
+}
+
+/**
+ * @brief DeviceRegistry::DeviceRegistry
+ * @param fbDir directory holding the framebuffer nodes, /dev
+ * @param inputDir directory holding the evdev nodes, /dev/input
+ * @param cacheFile where resolved paths are kept between runs
+ */
+DeviceRegistry::DeviceRegistry(const char *fbDir, const char *inputDir, const char *cacheFile)
+    : fbDir(fbDir), inputDir(inputDir), cacheFile(cacheFile)
+{
+    fbProbe = probe_framebuffer;
+    inputProbe = probe_input;
+    watchFd = -1;
+    fbWatch = -1;
+    inputWatch = -1;
+    Load();
+}
+
+DeviceRegistry::~DeviceRegistry(void)
+{
+    if (watchFd >= 0) { close(watchFd); }
+}
+
+/**
+ * @brief DeviceRegistry::SetProbes
+ * @details Replaces the ioctl identity checks, for directories of plain
+ *          files standing in for device nodes.
+ */
+void DeviceRegistry::SetProbes(DeviceProbe fbProbe, DeviceProbe inputProbe)
+{
+    this->fbProbe = fbProbe;
+    this->inputProbe = inputProbe;
+}
+
+/**
+ * @brief DeviceRegistry::OpenFramebuffer
+ * @param name the fb_fix_screeninfo id, "RPi-Sense FB"
+ * @return a read-write descriptor, or -1 if no such framebuffer exists
+ */
+int DeviceRegistry::OpenFramebuffer(const char *name)
+{
+    return Open(fbDir, DEVICE_FB_PREFIX, O_RDWR, fbProbe, name);
+}
+
+/**
+ * @brief DeviceRegistry::OpenInput
+ * @param name the evdev name, "Raspberry Pi Sense HAT Joystick"
+ * @return a non-blocking read-only descriptor, or -1 if there is no such device
+ */
+int DeviceRegistry::OpenInput(const char *name)
+{
+    return Open(inputDir, DEVICE_INPUT_PREFIX, O_RDONLY | O_NONBLOCK, inputProbe, name);
+}
+
+/**
+ * @brief DeviceRegistry::PathOf
+ * @return the node name was last found at, or "" if it has gone away since
+ */
+std::string DeviceRegistry::PathOf(const char *name)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, std::string>::iterator it;
+
+    it = paths.find(name);
+    return it == paths.end() ? std::string() : it->second;
+}
+
+int DeviceRegistry::Open(const std::string &dir, const char *prefix, int flags, const DeviceProbe &probe, const char *name)
+{
+    struct dirent **namelist;
+    std::string cached, path, found;
+    int i, ndev, fd;
+
+    cached = PathOf(name);
+    if (!cached.empty())
+    {
+        fd = open(cached.c_str(), flags | O_CLOEXEC);
+        if (fd >= 0 && probe(fd, name)) { return fd; }
+        if (fd >= 0) { close(fd); }
+    }
+
+    fd = -1;
+    ndev = scandir(dir.c_str(), &namelist, NULL, versionsort);
+    if (ndev < 0) { return -1; }
+    for (i = 0; i < ndev; i++)
+    {
+        path = dir + "/" + namelist[i]->d_name;
+        if (fd < 0 && path != cached && strncmp(prefix, namelist[i]->d_name, strlen(prefix)) == 0)
+        {
+            fd = open(path.c_str(), flags | O_CLOEXEC);
+            if (fd >= 0 && !probe(fd, name))
+            {
+                close(fd);
+                fd = -1;
+            }
+            if (fd >= 0) { found = path; }
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (fd >= 0) { paths[name] = found; }
+    else { paths.erase(name); }
+    if (found != cached) { Save(); }
+    return fd;
+}
+
+void DeviceRegistry::Forget(const std::string &path)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, std::string>::iterator it;
+
+    for (it = paths.begin(); it != paths.end(); )
+    {
+        if (it->second == path) { paths.erase(it++); }
+        else { ++it; }
+    }
+}
+
+/**
+ * @brief DeviceRegistry::Load
+ * @details The cache holds one "name<TAB>path" line per device.
+ */
+void DeviceRegistry::Load(void)
+{
+    FILE *fp;
+    char line[2 * DEVICE_NAME_SZ];
+    char *tab, *end;
+
+    fp = fopen(cacheFile.c_str(), "r");
+    if (fp == NULL) { return; }
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        tab = strchr(line, '\t');
+        end = strchr(line, '\n');
+        if (tab == NULL || end == NULL) { continue; }
+        *tab = 0;
+        *end = 0;
+        paths[line] = tab + 1;
+    }
+    fclose(fp);
+}
+
+/**
+ * @brief DeviceRegistry::Save
+ * @details Called with the lock held. Writes a temporary file and renames
+ *          it so a crash never leaves a torn cache.
+ */
+void DeviceRegistry::Save(void)
+{
+    std::map<std::string, std::string>::iterator it;
+    std::string tmp;
+    FILE *fp;
+
+    tmp = cacheFile + ".tmp";
+    fp = fopen(tmp.c_str(), "w");
+    if (fp == NULL) { return; }
+    for (it = paths.begin(); it != paths.end(); ++it)
+    {
+        fprintf(fp, "%s\t%s\n", it->first.c_str(), it->second.c_str());
+    }
+    if (fclose(fp) == 0) { rename(tmp.c_str(), cacheFile.c_str()); }
+}
+
+/**
+ * @brief DeviceRegistry::Watch
+ * @return a non-blocking inotify descriptor to poll, then ReadChanges()
+ */
+int DeviceRegistry::Watch(void)
+{
+    if (watchFd >= 0) { return watchFd; }
+    watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd < 0) { return -1; }
+    fbWatch = inotify_add_watch(watchFd, fbDir.c_str(), DEVICE_WATCH_MASK);
+    inputWatch = inotify_add_watch(watchFd, inputDir.c_str(), DEVICE_WATCH_MASK);
+    return watchFd;
+}
+
+/**
+ * @brief DeviceRegistry::ReadChanges
+ * @details Drains the pending inotify events. Nodes that disappeared are
+ *          forgotten, so PathOf() tells the caller its device is gone.
+ * @return DEVICE_FB_CHANGED and/or DEVICE_INPUT_CHANGED
+ */
+int DeviceRegistry::ReadChanges(void)
+{
+    char buf[DEVICE_WATCH_BUFSZ] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    const std::string *dir;
+    ssize_t len;
+    char *p;
+    int changed = 0, kind;
+
+    if (watchFd < 0) { return 0; }
+    while ((len = read(watchFd, buf, sizeof(buf))) > 0)
+    {
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len)
+        {
+            ev = (const struct inotify_event *)p;
+            if (ev->len == 0) { continue; }
+            kind = 0;
+            dir = NULL;
+            if (ev->wd == fbWatch && strncmp(DEVICE_FB_PREFIX, ev->name, strlen(DEVICE_FB_PREFIX)) == 0)
+            {
+                kind = DEVICE_FB_CHANGED;
+                dir = &fbDir;
+            }
+            if (ev->wd == inputWatch && strncmp(DEVICE_INPUT_PREFIX, ev->name, strlen(DEVICE_INPUT_PREFIX)) == 0)
+            {
+                kind = DEVICE_INPUT_CHANGED;
+                dir = &inputDir;
+            }
+            if (kind == 0) { continue; }
+            if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) { Forget(*dir + "/" + ev->name); }
+            changed |= kind;
+        }
+    }
+    return changed;
+}
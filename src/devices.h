@@ -0,0 +1,57 @@
+/**
+ * @file devices.h
+ * @details Finds the Sense HAT framebuffer and joystick nodes by name,
+ *          remembers where they were, and watches the device directories
+ *          for nodes coming and going.
+ */
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <functional>
+
+#define DEVICE_FB_PREFIX "fb"
+#define DEVICE_INPUT_PREFIX "event"
+#define DEVICE_NAME_SZ 256
+#define DEVICE_WATCH_BUFSZ 4096
+
+// ReadChanges() flags
+#define DEVICE_FB_CHANGED 0x01
+#define DEVICE_INPUT_CHANGED 0x02
+
+// Answers whether the open node fd is the device called name
+typedef std::function<bool(int fd, const char *name)> DeviceProbe;
+
+class DeviceRegistry
+{
+public:
+    DeviceRegistry(const char *fbDir, const char *inputDir, const char *cacheFile);
+    ~DeviceRegistry(void);
+    void SetProbes(DeviceProbe fbProbe, DeviceProbe inputProbe);
+    int OpenFramebuffer(const char *name);
+    int OpenInput(const char *name);
+    std::string PathOf(const char *name);
+    int Watch(void);
+    int ReadChanges(void);
+
+private:
+    int Open(const std::string &dir, const char *prefix, int flags, const DeviceProbe &probe, const char *name);
+    void Forget(const std::string &path);
+    void Load(void);
+    void Save(void);
+
+    std::string fbDir;
+    std::string inputDir;
+    std::string cacheFile;
+    DeviceProbe fbProbe;
+    DeviceProbe inputProbe;
+    std::mutex lock;
+    std::map<std::string, std::string> paths;
+    int watchFd;
+    int fbWatch;
+    int inputWatch;
+};
+
+#endif // DEVICES_H
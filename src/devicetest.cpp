@@ -0,0 +1,204 @@
+/**
+ * @file devicetest.cpp
+ * @details devicetest: checks DeviceRegistry against a temporary directory
+ *          of plain fbN and eventN files standing in for device nodes. Each
+ *          file holds the name its probe reports. Prints each failed check
+ *          and exits non-zero if there was one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <string>
+#include "devices.h"
+
+#define CHECK(cond) Check((cond), #cond, __LINE__)
+
+#define FB_NAME "RPi-Sense FB"
+#define INPUT_NAME "Raspberry Pi Sense HAT Joystick"
+#define WATCH_TIMEOUT 1000
+
+static int failures;
+static int probes;
+
+static void Check(bool ok, const char *what, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "devicetest.cpp:%d: %s\n", line, what);
+        failures++;
+    }
+}
+
+/**
+ * @brief Probe
+ * @details Stands in for the ioctl identity checks: the file's contents are
+ *          the device name.
+ */
+static bool Probe(int fd, const char *name)
+{
+    char buf[DEVICE_NAME_SZ];
+    ssize_t len;
+
+    probes++;
+    len = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (len < 0) { return false; }
+    buf[len] = 0;
+    return strcmp(buf, name) == 0;
+}
+
+static void Node(const std::string &path, const char *name)
+{
+    FILE *fp;
+
+    fp = fopen(path.c_str(), "w");
+    if (fp == NULL) { return; }
+    fputs(name, fp);
+    fclose(fp);
+}
+
+static std::string CacheOf(const std::string &cache)
+{
+    std::string text;
+    FILE *fp;
+    char buf[256];
+    size_t len;
+
+    fp = fopen(cache.c_str(), "r");
+    if (fp == NULL) { return text; }
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) { text.append(buf, len); }
+    fclose(fp);
+    return text;
+}
+
+static int Open(DeviceRegistry &reg, bool fb)
+{
+    int fd;
+
+    probes = 0;
+    fd = fb ? reg.OpenFramebuffer(FB_NAME) : reg.OpenInput(INPUT_NAME);
+    if (fd >= 0) { close(fd); }
+    return fd;
+}
+
+/**
+ * @brief Changes
+ * @details Waits for the watch to report something, then drains it.
+ */
+static int Changes(DeviceRegistry &reg, int wfd)
+{
+    struct pollfd pfd;
+
+    pfd.fd = wfd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, WATCH_TIMEOUT) <= 0) { return 0; }
+    return reg.ReadChanges();
+}
+
+int main(void)
+{
+    char tmpl[] = "/tmp/devicetestXXXXXX";
+    std::string root, dev, input, cache;
+    int wfd;
+
+    if (mkdtemp(tmpl) == NULL)
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    root = tmpl;
+    dev = root + "/dev";
+    input = dev + "/input";
+    cache = root + "/devices.cache";
+    mkdir(dev.c_str(), 0700);
+    mkdir(input.c_str(), 0700);
+    Node(dev + "/fb0", "bcm2708_fb");
+    Node(dev + "/fb1", FB_NAME);
+    Node(dev + "/null", FB_NAME);
+    Node(input + "/event0", "gpio-keys");
+    Node(input + "/event1", INPUT_NAME);
+
+    {
+        DeviceRegistry reg(dev.c_str(), input.c_str(), cache.c_str());
+
+        reg.SetProbes(Probe, Probe);
+        // No cache yet: a scan finds them and saves where
+        CHECK(Open(reg, true) >= 0);
+        CHECK(probes == 2);
+        CHECK(reg.PathOf(FB_NAME) == dev + "/fb1");
+        CHECK(Open(reg, false) >= 0);
+        CHECK(reg.PathOf(INPUT_NAME) == input + "/event1");
+        // Now a cache hit: one probe, no scan
+        CHECK(Open(reg, true) >= 0);
+        CHECK(probes == 1);
+        CHECK(CacheOf(cache) == std::string(FB_NAME "\t") + dev + "/fb1\n"
+            + INPUT_NAME "\t" + input + "/event1\n");
+    }
+
+    {
+        // A new registry loads the saved paths and needs no scan
+        DeviceRegistry reg(dev.c_str(), input.c_str(), cache.c_str());
+
+        reg.SetProbes(Probe, Probe);
+        CHECK(reg.PathOf(FB_NAME) == dev + "/fb1");
+        CHECK(reg.PathOf(INPUT_NAME) == input + "/event1");
+        CHECK(Open(reg, false) >= 0);
+        CHECK(probes == 1);
+
+        // The cached node now belongs to something else: rescan and resave
+        Node(dev + "/fb1", "vc4drmfb");
+        Node(dev + "/fb2", FB_NAME);
+        CHECK(Open(reg, true) >= 0);
+        CHECK(probes > 1);
+        CHECK(reg.PathOf(FB_NAME) == dev + "/fb2");
+        CHECK(CacheOf(cache).find(dev + "/fb2\n") != std::string::npos);
+
+        // Gone altogether: the failed lookup is forgotten
+        unlink((dev + "/fb2").c_str());
+        CHECK(Open(reg, true) < 0);
+        CHECK(reg.PathOf(FB_NAME).empty());
+        CHECK(CacheOf(cache).find(FB_NAME) == std::string::npos);
+    }
+
+    {
+        DeviceRegistry reg(dev.c_str(), input.c_str(), cache.c_str());
+
+        reg.SetProbes(Probe, Probe);
+        wfd = reg.Watch();
+        CHECK(wfd >= 0);
+        CHECK(reg.Watch() == wfd);
+        CHECK(reg.ReadChanges() == 0);
+
+        // A node appearing is reported against its directory
+        Node(dev + "/fb3", FB_NAME);
+        CHECK(Changes(reg, wfd) == DEVICE_FB_CHANGED);
+        CHECK(Open(reg, true) >= 0);
+        CHECK(reg.PathOf(FB_NAME) == dev + "/fb3");
+
+        // Files that aren't device nodes are ignored
+        Node(input + "/mouse0", "mouse");
+        Node(input + "/event2", "other");
+        CHECK(Changes(reg, wfd) == DEVICE_INPUT_CHANGED);
+
+        // A node disappearing is reported and its path forgotten
+        unlink((input + "/event1").c_str());
+        CHECK(Changes(reg, wfd) == DEVICE_INPUT_CHANGED);
+        CHECK(reg.PathOf(INPUT_NAME).empty());
+        CHECK(reg.PathOf(FB_NAME) == dev + "/fb3");
+        CHECK(Open(reg, false) < 0);
+    }
+
+    if (system(("rm -rf " + root).c_str()) != 0)
+    {
+        fprintf(stderr, "devicetest: can't remove %s\n", root.c_str());
+    }
+    if (failures > 0)
+    {
+        fprintf(stderr, "devicetest: %d failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    fprintf(stdout, "devicetest: ok\n");
+    return EXIT_SUCCESS;
+}
@@ -1,10 +1,13 @@
+#include <stdint.h>
+
 typedef struct
 {
-	char caractere;
+	unsigned char caractere;
 	bool binarypattern[8][8];
 }Tfont;
 
-const Tfont font[] = {
+// Source glyphs. Only read at compile time to build the glyphs table below.
+constexpr Tfont font[] = {
 	{'\n',{
 			{0,0,0,0,0,0,0,0},
 			{0,0,0,0,0,0,0,0},
@@ -1080,3 +1083,63 @@ const Tfont font[] = {
 		  }
 	}
 };
+
+#define FONT_UNKNOWN_GLYPH 255
+
+// Packed glyphs: bit (row*8 + column) is set when the pixel is lit.
+// left and width give the lit columns, so empty columns need no scan.
+struct GlyphTable
+{
+	uint64_t bits[256];
+	uint8_t left[256];
+	uint8_t width[256];
+};
+
+constexpr GlyphTable MakeGlyphTable(void)
+{
+	GlyphTable table{};
+	bool present[256]{};
+	uint8_t columns = 0;
+	int i = 0, j = 0, k = 0, c = 0;
+
+	// First definition wins, as with the old linear search
+	for (i = 0; i < (int)(sizeof(font) / sizeof(Tfont)); i++)
+	{
+		c = font[i].caractere;
+		if (present[c]) { continue; }
+		present[c] = true;
+		columns = 0;
+		for (j = 0; j < 8; j++)
+		{
+			for (k = 0; k < 8; k++)
+			{
+				if (font[i].binarypattern[j][k])
+				{
+					table.bits[c] |= 1ULL << (j * 8 + k);
+					columns |= 1 << k;
+				}
+			}
+		}
+		if (columns != 0)
+		{
+			k = 0;
+			while (!(columns & (1 << k))) { k++; }
+			table.left[c] = k;
+			k = 7;
+			while (!(columns & (1 << k))) { k--; }
+			table.width[c] = k + 1 - table.left[c];
+		}
+	}
+	for (c = 0; c < 256; c++)
+	{
+		if (!present[c])
+		{
+			table.bits[c] = table.bits[FONT_UNKNOWN_GLYPH];
+			table.left[c] = table.left[FONT_UNKNOWN_GLYPH];
+			table.width[c] = table.width[FONT_UNKNOWN_GLYPH];
+		}
+	}
+	return table;
+}
+
+constexpr GlyphTable glyphs = MakeGlyphTable();
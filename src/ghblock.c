@@ -0,0 +1,451 @@
+/** @brief Gh compressed history blocks
+ *  @file ghblock.c
+ *  @details A block file (ghdata.blk) is a run of blockheader_s followed by
+ *           a bit stream of up to GHBLOCKPTS points. Timestamps are stored
+ *           as delta-of-delta of realtime milliseconds. Temperature,
+ *           humidity and pressure are stored as deltas of fixed-point
+ *           tenths, which is the resolution the CSV log keeps. Every integer
+ *           uses the same prefix code:
+ *
+ *               0                 zero
+ *               10   + 3 bits     -4 .. 3
+ *               110  + 7 bits     -64 .. 63
+ *               1110 + 12 bits    -2048 .. 2047
+ *               1111 + raw        the absolute value (64 bits time, 32 bits value)
+ *
+ *           A steady 2 s stride and slow drift cost about one to three bits
+ *           per field, against 46 bytes per CSV line.
+ */
+#include "ghblock.h"
+#include "ghlog.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BUCKETS 3
+
+static const int bucketbits[BUCKETS] = {3, 7, 12};
+
+static void GhBlockPut(blockwriter_s * bw, uint64_t value, int nbits)
+{
+	bw->acc = (bw->acc << nbits) | (value & ((1ULL << nbits) - 1));
+	bw->accbits += nbits;
+	while (bw->accbits >= 8)
+	{
+		bw->accbits -= 8;
+		bw->buf[bw->len++] = (uint8_t)(bw->acc >> bw->accbits);
+	}
+}
+
+static int GhBlockFits(int64_t value, int nbits)
+{
+	return value >= -(1LL << (nbits - 1)) && value < (1LL << (nbits - 1));
+}
+
+/** @brief Writes one integer with the prefix code, or the raw escape.
+ */
+static void GhBlockPutCode(blockwriter_s * bw, int64_t value, int64_t raw, int rawbits)
+{
+	int i;
+
+	if (value == 0)
+	{
+		GhBlockPut(bw, 0, 1);
+		return;
+	}
+	for (i = 0; i < BUCKETS; i++)
+	{
+		if (GhBlockFits(value, bucketbits[i]))
+		{
+			// i + 1 ones then a zero
+			GhBlockPut(bw, ((1ULL << (i + 1)) - 1) << 1, i + 2);
+			GhBlockPut(bw, (uint64_t)value, bucketbits[i]);
+			return;
+		}
+	}
+	GhBlockPut(bw, 0xF, 4);
+	if (rawbits > 32)
+	{
+		GhBlockPut(bw, (uint64_t)raw >> 32, rawbits - 32);
+		rawbits = 32;
+	}
+	GhBlockPut(bw, (uint64_t)raw, rawbits);
+}
+
+static int32_t GhBlockQuantize(float value)
+{
+	float scaled;
+
+	scaled = value * GHBLOCKSCALE;
+	if (!isfinite(scaled) || scaled >= 2147483647.0f || scaled <= -2147483647.0f)
+	{
+		return GHBLOCKNAN;
+	}
+	return (int32_t)lrintf(scaled);
+}
+
+static float GhBlockDequantize(int32_t value)
+{
+	if (value == GHBLOCKNAN)
+	{
+		return nanf("");
+	}
+	return value / GHBLOCKSCALE;
+}
+
+static int GhBlockWriteAll(int fd, const void * data, size_t len)
+{
+	const char * p = (const char *)data;
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = write(fd, p, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return 0;
+		}
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static void GhBlockReset(blockwriter_s * bw)
+{
+	bw->count = 0;
+	bw->dprev = 0;
+	memset(bw->vprev, 0, sizeof(bw->vprev));
+	bw->acc = 0;
+	bw->accbits = 0;
+	bw->len = sizeof(blockheader_s);
+}
+
+int GhBlockOpen(blockwriter_s * bw, const char * fname)
+{
+	char bname[GHLOGFNAMESZ];
+	blockheader_s hdr;
+	struct stat st;
+	off_t end = 0;
+
+	GhLogSidecarName(bname, sizeof(bname), fname, "blk");
+	bw->fd = open(bname, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (bw->fd < 0)
+	{
+		return 0;
+	}
+	if (fstat(bw->fd, &st) < 0)
+	{
+		GhBlockClose(bw);
+		return 0;
+	}
+	// Walk the block headers and cut off a block a crash left half written
+	while (end + (off_t)sizeof(hdr) <= st.st_size)
+	{
+		if (pread(bw->fd, &hdr, sizeof(hdr), end) != sizeof(hdr)
+				|| memcmp(hdr.magic, GHBLOCKMAGIC, sizeof(hdr.magic)) != 0
+				|| end + (off_t)sizeof(hdr) + hdr.nbytes > st.st_size)
+		{
+			break;
+		}
+		end += sizeof(hdr) + hdr.nbytes;
+	}
+	if (end != st.st_size)
+	{
+		ftruncate(bw->fd, end);
+	}
+	GhBlockReset(bw);
+	return 1;
+}
+
+int GhBlockAppend(blockwriter_s * bw, reading_s ghdata)
+{
+	int64_t t, delta, dod;
+	int32_t q[GHBLOCKVALUES];
+	int i;
+
+	if (bw->fd < 0)
+	{
+		return 0;
+	}
+	t = ghdata.ntime / GHBLOCKTICK;
+	if (bw->count == 0)
+	{
+		bw->opened = ghdata.rtime;
+		bw->tfirst = t;
+		bw->tprev = t;
+	}
+	delta = t - bw->tprev;
+	dod = delta - bw->dprev;
+	GhBlockPutCode(bw, dod, t, 64);
+	bw->tprev = t;
+	bw->dprev = delta;
+
+	q[0] = GhBlockQuantize(ghdata.temperature);
+	q[1] = GhBlockQuantize(ghdata.humidity);
+	q[2] = GhBlockQuantize(ghdata.pressure);
+	for (i = 0; i < GHBLOCKVALUES; i++)
+	{
+		GhBlockPutCode(bw, (int64_t)q[i] - bw->vprev[i], (uint32_t)q[i], 32);
+		bw->vprev[i] = q[i];
+	}
+	bw->count++;
+	if (bw->count == GHBLOCKPTS || ghdata.rtime - bw->opened >= GHBLOCKFLUSHAGE)
+	{
+		return GhBlockFlush(bw);
+	}
+	return 1;
+}
+
+int GhBlockFlush(blockwriter_s * bw)
+{
+	blockheader_s hdr;
+	int ok;
+
+	if (bw->fd < 0 || bw->count == 0)
+	{
+		return 1;
+	}
+	if (bw->accbits > 0)
+	{
+		GhBlockPut(bw, 0, 8 - bw->accbits);
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, GHBLOCKMAGIC, sizeof(hdr.magic));
+	hdr.version = GHBLOCKVERSION;
+	hdr.count = bw->count;
+	hdr.nbytes = bw->len - sizeof(hdr);
+	hdr.tfirst = bw->tfirst;
+	hdr.tlast = bw->tprev;
+	memcpy(bw->buf, &hdr, sizeof(hdr));
+	ok = GhBlockWriteAll(bw->fd, bw->buf, bw->len);
+	GhBlockReset(bw);
+	return ok;
+}
+
+void GhBlockClose(blockwriter_s * bw)
+{
+	if (bw->fd < 0)
+	{
+		return;
+	}
+	GhBlockFlush(bw);
+	close(bw->fd);
+	bw->fd = -1;
+}
+
+int GhBlockScanOpen(blockscan_s * bs, const char * fname)
+{
+	char bname[GHLOGFNAMESZ];
+	struct stat st;
+	int fd;
+
+	memset(bs, 0, sizeof(*bs));
+	bs->from = INT64_MIN;
+	GhLogSidecarName(bname, sizeof(bname), fname, "blk");
+	fd = open(bname, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		return 0;
+	}
+	bs->mapsz = st.st_size;
+	if (bs->mapsz > 0)
+	{
+		bs->map = (const uint8_t *)mmap(NULL, bs->mapsz, PROT_READ, MAP_SHARED, fd, 0);
+		if (bs->map == MAP_FAILED)
+		{
+			bs->map = NULL;
+			close(fd);
+			return 0;
+		}
+		madvise((void *)bs->map, bs->mapsz, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	return 1;
+}
+
+/** @brief Copies the header at offset at into hdr.
+ *  @return 1 if it is a block of this version that fits in the map
+ */
+static int GhBlockHeader(const blockscan_s * bs, size_t at, blockheader_s * hdr)
+{
+	if (at + sizeof(*hdr) > bs->mapsz)
+	{
+		return 0;
+	}
+	memcpy(hdr, bs->map + at, sizeof(*hdr));
+	return memcmp(hdr->magic, GHBLOCKMAGIC, sizeof(hdr->magic)) == 0
+		&& hdr->version == GHBLOCKVERSION
+		&& at + sizeof(*hdr) + hdr->nbytes <= bs->mapsz;
+}
+
+/** @brief Moves to the first block that can hold times at or after ntime.
+ *  @details Whole blocks are skipped on their header alone; GhBlockScanNext()
+ *           drops the earlier points of the block it lands in. The walk
+ *           stops at the first header that is not a valid block.
+ *  @return 0 if no valid block reaches ntime
+ */
+int GhBlockScanSeek(blockscan_s * bs, int64_t ntime)
+{
+	blockheader_s hdr;
+	size_t at = 0;
+	int ok;
+
+	bs->remain = 0;
+	bs->from = ntime;
+	while ((ok = GhBlockHeader(bs, at, &hdr)) && hdr.tlast * GHBLOCKTICK < ntime)
+	{
+		at += sizeof(hdr) + hdr.nbytes;
+	}
+	bs->next = at;
+	return ok;
+}
+
+/** @brief Realtime just past the last stored point, INT64_MIN if none.
+ *  @details Times are kept to the block tick, so a reading within the tick
+ *           of the last stored point counts as stored.
+ */
+int64_t GhBlockScanEnd(const blockscan_s * bs)
+{
+	blockheader_s hdr;
+	int64_t end = INT64_MIN;
+	size_t at = 0;
+
+	while (GhBlockHeader(bs, at, &hdr))
+	{
+		end = (hdr.tlast + 1) * GHBLOCKTICK;
+		at += sizeof(hdr) + hdr.nbytes;
+	}
+	return end;
+}
+
+static uint64_t GhBlockGet(blockscan_s * bs, int nbits)
+{
+	while (bs->accbits < nbits)
+	{
+		bs->acc = (bs->acc << 8) | (bs->p < bs->end ? *bs->p++ : 0);
+		bs->accbits += 8;
+	}
+	bs->accbits -= nbits;
+	return (bs->acc >> bs->accbits) & ((1ULL << nbits) - 1);
+}
+
+/** @brief Reads one prefix-coded integer; *raw is set when it is an escape.
+ */
+static int64_t GhBlockGetCode(blockscan_s * bs, int rawbits, int * raw)
+{
+	int ones = 0;
+	uint64_t value;
+	int nbits;
+
+	*raw = 0;
+	while (ones < BUCKETS + 1 && GhBlockGet(bs, 1))
+	{
+		ones++;
+	}
+	if (ones == 0)
+	{
+		return 0;
+	}
+	if (ones > BUCKETS)
+	{
+		*raw = 1;
+		value = 0;
+		if (rawbits > 32)
+		{
+			value = GhBlockGet(bs, rawbits - 32) << 32;
+			rawbits = 32;
+		}
+		return (int64_t)(value | GhBlockGet(bs, rawbits));
+	}
+	nbits = bucketbits[ones - 1];
+	value = GhBlockGet(bs, nbits);
+	// Sign extend from nbits
+	return (int64_t)(value << (64 - nbits)) >> (64 - nbits);
+}
+
+static int GhBlockScanLoad(blockscan_s * bs)
+{
+	blockheader_s hdr;
+
+	if (!GhBlockHeader(bs, bs->next, &hdr))
+	{
+		return 0;
+	}
+	bs->p = bs->map + bs->next + sizeof(hdr);
+	bs->end = bs->p + hdr.nbytes;
+	bs->next += sizeof(hdr) + hdr.nbytes;
+	bs->remain = hdr.count;
+	bs->tprev = hdr.tfirst;
+	bs->dprev = 0;
+	memset(bs->vprev, 0, sizeof(bs->vprev));
+	bs->acc = 0;
+	bs->accbits = 0;
+	return 1;
+}
+
+int GhBlockScanNext(blockscan_s * bs, reading_s * rd)
+{
+	int64_t code;
+	int raw, i;
+
+	do
+	{
+		if (bs->remain == 0 && !GhBlockScanLoad(bs))
+		{
+			return 0;
+		}
+		code = GhBlockGetCode(bs, 64, &raw);
+		if (raw)
+		{
+			bs->dprev = code - bs->tprev;
+			bs->tprev = code;
+		}
+		else
+		{
+			bs->dprev += code;
+			bs->tprev += bs->dprev;
+		}
+		for (i = 0; i < GHBLOCKVALUES; i++)
+		{
+			code = GhBlockGetCode(bs, 32, &raw);
+			bs->vprev[i] = raw ? (int32_t)(uint32_t)code : (int32_t)(bs->vprev[i] + code);
+		}
+		bs->remain--;
+	}
+	while (bs->tprev * GHBLOCKTICK < bs->from);
+
+	// Monotonic time means nothing after a reboot, so only realtime is kept
+	rd->mtime = 0;
+	rd->sampled = 0;
+	rd->ntime = bs->tprev * GHBLOCKTICK;
+	rd->rtime = (time_t)(rd->ntime / GHNSPERSEC);
+	rd->temperature = GhBlockDequantize(bs->vprev[0]);
+	rd->humidity = GhBlockDequantize(bs->vprev[1]);
+	rd->pressure = GhBlockDequantize(bs->vprev[2]);
+	rd->stale = 0;
+	return 1;
+}
+
+void GhBlockScanClose(blockscan_s * bs)
+{
+	if (bs->map != NULL)
+	{
+		munmap((void *)bs->map, bs->mapsz);
+	}
+	memset(bs, 0, sizeof(*bs));
+}
@@ -0,0 +1,87 @@
+/** @brief Gh compressed history block constants, structures, function prototypes
+ *  @file ghblock.h
+ */
+
+#ifndef GHBLOCK_H
+#define GHBLOCK_H
+
+// Includes
+//
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "ghcontrol.h"
+
+// Constants
+
+#define GHBLOCKMAGIC "GHBK"
+#define GHBLOCKVERSION 1
+// Nanoseconds per stored time unit
+#define GHBLOCKTICK 1000000LL
+#define GHBLOCKPTS 1024
+#define GHBLOCKFLUSHAGE 600
+#define GHBLOCKVALUES 3
+#define GHBLOCKSCALE 10.0f
+#define GHBLOCKNAN INT32_MIN
+// Worst case per point: 68 bits of time and 36 bits per value
+#define GHBLOCKBUFSZ (sizeof(blockheader_s) + GHBLOCKPTS * 22 + 8)
+
+// Structures
+
+typedef struct blockheader
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t count;
+	uint32_t nbytes;
+	uint32_t reserved;
+	int64_t tfirst;
+	int64_t tlast;
+}blockheader_s;
+
+typedef struct blockwriter
+{
+	int fd;
+	int count;
+	time_t opened;
+	int64_t tfirst;
+	int64_t tprev;
+	int64_t dprev;
+	int32_t vprev[GHBLOCKVALUES];
+	uint64_t acc;
+	int accbits;
+	size_t len;
+	uint8_t buf[GHBLOCKBUFSZ];
+}blockwriter_s;
+
+typedef struct blockscan
+{
+	const uint8_t * map;
+	size_t mapsz;
+	size_t next;
+	int64_t from;
+	int remain;
+	int64_t tprev;
+	int64_t dprev;
+	int32_t vprev[GHBLOCKVALUES];
+	const uint8_t * p;
+	const uint8_t * end;
+	uint64_t acc;
+	int accbits;
+}blockscan_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+int GhBlockOpen(blockwriter_s * bw, const char * fname);
+int GhBlockAppend(blockwriter_s * bw, reading_s ghdata);
+int GhBlockFlush(blockwriter_s * bw);
+void GhBlockClose(blockwriter_s * bw);
+int GhBlockScanOpen(blockscan_s * bs, const char * fname);
+int GhBlockScanSeek(blockscan_s * bs, int64_t ntime);
+int64_t GhBlockScanEnd(const blockscan_s * bs);
+int GhBlockScanNext(blockscan_s * bs, reading_s * rd);
+void GhBlockScanClose(blockscan_s * bs);
+
+///@endcond
+#endif
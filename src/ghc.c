@@ -3,35 +3,217 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include "ghcmd.h"
 #include "ghcontrol.h"
+#include "ghhttp.h"
+#include "ghmcast.h"
+#include "ghrate.h"
+#include "ghring.h"
+#include "ghsched.h"
+#include "ghshm.h"
 
-int main(void){
+typedef struct ghstate
+{
+	reading_s creadings;
+	control_s ctrl;
+	setpoint_s sets;
+	ratepolicy_s rate;
+	sched_s * sch;
+	shmseg_s * shm;
+	httpserver_s * http;
+	mcastsender_s mcast;
+	ring_s * ring;
+}ghstate_s;
 
-	int logged;
-	time_t now;
-	struct readings creadings = {0};
-    struct controls ctrl = {0};
-	struct setpoints sets = {0};
+/** @brief Makes the latest state visible to other processes.
+ */
+static void GhPublish(ghstate_s * gs)
+{
+	if (gs->shm != NULL)
+	{
+		GhShmPublish(gs->shm, gs->creadings, gs->ctrl, gs->sets, GhGetSensorStats());
+	}
+}
 
-	GhControllerInit();
-	GhDisplayHeader("Darshan Prajapati");
+/** @brief Moves every periodic task to the policy's period.
+ */
+static void GhApplyRate(ghstate_s * gs, int period)
+{
+	GhSchedSetPeriod(gs->sch, "sample", period);
+	GhSchedSetPeriod(gs->sch, "log", period);
+	GhSchedSetPeriod(gs->sch, "display", period);
+	GhSchedSetPeriod(gs->sch, "console", period);
+	GhSetUpdatePeriod("ghdata.txt", gs->creadings.rtime, period, GhRateReason(gs->rate.reason));
+}
 
+static void GhSampleTask(void * arg)
+{
+	ghstate_s * gs = (ghstate_s *)arg;
+	int period;
 
-	sets = GhSetTargets();
-	while(1)
+	gs->creadings = GhGetReadings();
+	GhRingPush(gs->ring, gs->creadings);
+	gs->ctrl = GhSetControls(gs->sets, gs->creadings);
+	GhPublish(gs);
+	GhHttpPublish(gs->http, gs->creadings);
+	GhMcastSend(&gs->mcast, gs->creadings, gs->ctrl);
+	period = gs->rate.period;
+	if (GhRateUpdate(&gs->rate, gs->creadings, gs->sets) != period)
 	{
+		GhApplyRate(gs, gs->rate.period);
+	}
+}
+
+static void GhLogTask(void * arg)
+{
+	ghstate_s * gs = (ghstate_s *)arg;
+
+	GhLogData("ghdata.txt", gs->creadings);
+}
 
-		now = time(NULL);
-        creadings = GhGetReadings();
-		ctrl = GhSetControls(sets, creadings);
-		GhDisplayAll(creadings,sets);
-		logged = GhLogData("ghdata.txt",creadings);
-        GhDisplayReadings(creadings);
-        GhDisplayTargets(sets);
-        GhDisplayControls(ctrl);
-        GhDelay(GHUPDATE);
+static void GhDisplayTask(void * arg)
+{
+	ghstate_s * gs = (ghstate_s *)arg;
 
+	GhDisplayAll(gs->creadings, gs->sets);
+}
+
+static void GhConsoleTask(void * arg)
+{
+	ghstate_s * gs = (ghstate_s *)arg;
+
+	GhDisplayReadings(gs->creadings);
+	GhDisplayTargets(gs->sets);
+	GhDisplayControls(gs->ctrl);
+	fprintf(stdout, " Rate\t\tPeriod: %ds\tLast: %s\tSlower: %lu\tFaster: %lu\n",
+			gs->rate.period / 1000, GhRateReason(gs->rate.reason), gs->rate.decisions[GHRATESLOWER],
+			gs->rate.decisions[GHRATEFASTER] + gs->rate.decisions[GHRATECHANGE]
+			+ gs->rate.decisions[GHRATENEAR] + gs->rate.decisions[GHRATEEDIT]);
+}
+
+/** @brief Takes new setpoints from the joystick or the command socket.
+ */
+static void GhApplySetpoints(setpoint_s sets, void * arg)
+{
+	ghstate_s * gs = (ghstate_s *)arg;
+	int period;
+
+	gs->sets = sets;
+	gs->ctrl = GhSetControls(gs->sets, gs->creadings);
+	GhPublish(gs);
+	GhDisplayAll(gs->creadings, gs->sets);
+	period = gs->rate.period;
+	if (GhRateReset(&gs->rate, GHRATEEDIT) != period)
+	{
+		GhApplyRate(gs, gs->rate.period);
+	}
+}
+
+static void GhInputSource(int fd, uint32_t events, void * arg)
+{
+	ghstate_s * gs = (ghstate_s *)arg;
+	setpoint_s sets;
 
+	sets = GhEditSetpoints(gs->sets);
+	if (sets.temperature != gs->sets.temperature || sets.humidity != gs->sets.humidity)
+	{
+		GhApplySetpoints(sets, gs);
+	}
+}
+
+int main(void){
+
+	static ghstate_s gs = {0};
+	static ring_s ring;
+	static cmdserver_s cmd;
+	static httpserver_s http;
+	sched_s sch;
+	int stopped;
+
+	// Readers in other processes see the ring inside the segment
+	gs.shm = GhShmCreate(GHSHMNAME);
+	if (gs.shm != NULL)
+	{
+		gs.ring = &gs.shm->ring;
+	}
+	else if (errno == EBUSY)
+	{
+		// Two controllers would fight over the sensors and the log
+		fprintf(stdout, "\nAnother controller owns %s, not started!\n", GHSHMNAME);
+		return EXIT_FAILURE;
+	}
+	else
+	{
+		fprintf(stdout, "\nCan't create shared memory %s, state not published\n", GHSHMNAME);
+		GhRingInit(&ring);
+		gs.ring = &ring;
+	}
+	GhControllerInit();
+	GhDisplayHeader("Darshan Prajapati");
+
+	gs.sets = GhSetTargets();
+	gs.sch = &sch;
+	GhRateInit(&gs.rate, GHRATEMIN, GHRATEMAX);
+
+	if (!GhSchedInit(&sch))
+	{
+		fprintf(stdout, "\nCan't create scheduler, controller not started!\n");
+		GhShmDestroy(gs.shm, GHSHMNAME);
+		return EXIT_FAILURE;
+	}
+	// Tasks due at the same deadline run in the order they are added
+	GhSchedAddTask(&sch, "sample", GHUPDATE, GhSampleTask, &gs);
+	GhSchedAddTask(&sch, "log", GHLOGUPDATE, GhLogTask, &gs);
+	GhSchedAddTask(&sch, "display", GHDISPUPDATE, GhDisplayTask, &gs);
+	GhSchedAddTask(&sch, "console", GHCONUPDATE, GhConsoleTask, &gs);
+	// Joystick edits to the setpoints take effect as soon as they arrive
+	GhSchedAddFd(&sch, GhJoystickFd(), EPOLLIN, GhInputSource, &gs);
+	if (GhCmdOpen(&cmd, &sch, GHCMDPATH))
+	{
+		cmd.logname = "ghdata.txt";
+		cmd.rd = &gs.creadings;
+		cmd.sets = &gs.sets;
+		cmd.ring = gs.ring;
+		cmd.rate = &gs.rate;
+		cmd.apply = GhApplySetpoints;
+		cmd.arg = &gs;
+	}
+	else
+	{
+		fprintf(stdout, "\nCan't open command socket %s\n", GHCMDPATH);
+	}
+	gs.http = &http;
+	if (GhHttpOpen(&http, &sch, GHHTTPADDR, GHHTTPPORT))
+	{
+		http.logname = "ghdata.txt";
+		http.rd = &gs.creadings;
+		http.ctrl = &gs.ctrl;
+		http.sets = &gs.sets;
+		http.ring = gs.ring;
+	}
+	else
+	{
+		fprintf(stdout, "\nCan't listen for HTTP on port %d\n", GHHTTPPORT);
+	}
+	gs.mcast.fd = -1;
+#if GHMCAST
+	if (!GhMcastOpen(&gs.mcast, GHMCASTGROUP, GHMCASTPORT, NULL, GhGetSerial(), GHZONE))
+	{
+		fprintf(stdout, "\nCan't send to multicast group %s:%d\n", GHMCASTGROUP, GHMCASTPORT);
+	}
+#endif
+	stopped = GhSchedRun(&sch);
+	GhMcastClose(&gs.mcast);
+	GhHttpClose(&http);
+	GhCmdClose(&cmd);
+	GhSchedClose(&sch);
+	GhShmDestroy(gs.shm, GHSHMNAME);
+	GhControllerShutdown();
+	if (stopped)
+	{
+		return EXIT_SUCCESS;
 	}
 
        	//fprintf(stdout,"Press ENTER to continue...");
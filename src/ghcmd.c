@@ -0,0 +1,399 @@
+/** @brief Gh command socket
+ *  @file ghcmd.c
+ *  @details A Unix stream socket (ghcontrol.sock) served from the scheduler
+ *           loop. Every socket is non-blocking and each wakeup sends at most
+ *           GHCMDBUDGET bytes per client, so clients never delay a task.
+ *           Requests and replies are text lines:
+ *
+ *               readings                 ok <ntime> <temp> <humid> <press> <stale>
+ *               setpoints                ok <temp> <humid>
+ *               setpoints <temp> <humid> ok <temp> <humid>, saved to setpoints.dat
+ *               history <from> <to> [max]
+ *                                        ok, then one "<ntime> <temp> <humid> <press>"
+ *                                        line per reading with from <= ntime < to,
+ *                                        then "end <rows>"
+ *               stats                    ok samples=... nans=... period=... ...
+ *
+ *           Times are realtime nanoseconds. Anything else gets "err <why>".
+ *           History comes from the columns and blocks, then from the readings
+ *           ring for what is not flushed yet, and is streamed a buffer at a
+ *           time as the client drains it.
+ */
+#include "ghcmd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+static void GhCmdDrop(cmdclient_s * c)
+{
+	GhSchedDelFd(c->srv->sch, c->fd);
+	close(c->fd);
+	GhHistCursorClose(&c->hc);
+	c->fd = -1;
+	c->srv->nclients--;
+}
+
+static void GhCmdReply(cmdclient_s * c, const char * fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void GhCmdReply(cmdclient_s * c, const char * fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(c->out + c->outlen, sizeof(c->out) - c->outlen, fmt, ap);
+	va_end(ap);
+	if (n > 0)
+	{
+		c->outlen += (size_t)n < sizeof(c->out) - c->outlen ? (size_t)n : sizeof(c->out) - c->outlen - 1;
+	}
+}
+
+/** @return 1 if all of arg is a number, 0 otherwise
+ */
+static int GhCmdFloat(const char * arg, float * v)
+{
+	char * end;
+
+	errno = 0;
+	*v = strtof(arg, &end);
+	return end != arg && *end == '\0' && errno == 0;
+}
+
+static int GhCmdInt(const char * arg, long long * v)
+{
+	char * end;
+
+	errno = 0;
+	*v = strtoll(arg, &end, 10);
+	return end != arg && *end == '\0' && errno == 0;
+}
+
+static void GhCmdHistory(cmdclient_s * c, int64_t from, int64_t to, size_t maxrows)
+{
+	c->streaming = 1;
+	c->rows = 0;
+	c->maxrows = maxrows;
+	GhHistCursorOpen(&c->hc, c->srv->logname, c->srv->ring, from, to);
+	GhCmdReply(c, "ok\n");
+}
+
+/** @brief Adds history rows until the output buffer is full or the range ends.
+ */
+static void GhCmdFill(cmdclient_s * c)
+{
+	reading_s rd;
+	int more = 1;
+
+	while (c->outlen + GHCMDROWSZ < sizeof(c->out) && c->rows < c->maxrows
+			&& (more = GhHistCursorNext(&c->hc, &rd)))
+	{
+		GhCmdReply(c, "%lld %.2f %.2f %.2f\n", (long long)rd.ntime,
+				rd.temperature, rd.humidity, rd.pressure);
+		c->rows++;
+	}
+	if (!more || c->rows == c->maxrows)
+	{
+		GhCmdReply(c, "end %zu\n", c->rows);
+		GhHistCursorClose(&c->hc);
+		c->streaming = 0;
+	}
+}
+
+static void GhCmdExecute(cmdclient_s * c, char * line)
+{
+	cmdserver_s * srv = c->srv;
+	const reading_s * rd = srv->rd;
+	sensorstats_s st;
+	setpoint_s sets;
+	char * argv[4];
+	long long from, to, max;
+	char * save;
+	int argc;
+
+	for (argc = 0; argc < 4; argc++)
+	{
+		argv[argc] = strtok_r(argc == 0 ? line : NULL, " \t\r", &save);
+		if (argv[argc] == NULL)
+		{
+			break;
+		}
+	}
+	srv->requests++;
+	if (argc == 0)
+	{
+		GhCmdReply(c, "err empty request\n");
+	}
+	else if (strcmp(argv[0], "readings") == 0 && argc == 1)
+	{
+		GhCmdReply(c, "ok %lld %.2f %.2f %.2f %d\n", (long long)rd->ntime,
+				rd->temperature, rd->humidity, rd->pressure, rd->stale);
+	}
+	else if (strcmp(argv[0], "setpoints") == 0 && argc == 1)
+	{
+		GhCmdReply(c, "ok %.1f %.1f\n", srv->sets->temperature, srv->sets->humidity);
+	}
+	else if (strcmp(argv[0], "setpoints") == 0 && argc == 3)
+	{
+		if (!GhCmdFloat(argv[1], &sets.temperature) || !GhCmdFloat(argv[2], &sets.humidity))
+		{
+			GhCmdReply(c, "err bad setpoints\n");
+		}
+		else if (!(sets.temperature >= LSTEMP && sets.temperature <= USTEMP)
+				|| !(sets.humidity >= LSHUMID && sets.humidity <= USHUMID))
+		{
+			GhCmdReply(c, "err setpoints out of range\n");
+		}
+		else if (!GhSaveSetpoints("setpoints.dat", sets))
+		{
+			GhCmdReply(c, "err can't save setpoints\n");
+		}
+		else
+		{
+			srv->apply(sets, srv->arg);
+			GhCmdReply(c, "ok %.1f %.1f\n", srv->sets->temperature, srv->sets->humidity);
+		}
+	}
+	else if (strcmp(argv[0], "history") == 0 && (argc == 3 || argc == 4))
+	{
+		max = GHCMDMAXROWS;
+		if (!GhCmdInt(argv[1], &from) || !GhCmdInt(argv[2], &to)
+				|| (argc == 4 && !GhCmdInt(argv[3], &max)))
+		{
+			GhCmdReply(c, "err bad history range\n");
+		}
+		else
+		{
+			if (max <= 0 || max > GHCMDMAXROWS)
+			{
+				max = GHCMDMAXROWS;
+			}
+			GhCmdHistory(c, from, to, max);
+		}
+	}
+	else if (strcmp(argv[0], "stats") == 0 && argc == 1)
+	{
+		st = GhGetSensorStats();
+		GhCmdReply(c, "ok samples=%llu nans=%llu retries=%llu timeouts=%llu stalls=%llu dropped=%llu"
+				" period=%d reason=%s clients=%d requests=%lu rejected=%lu\n",
+				(unsigned long long)st.samples, (unsigned long long)st.nans,
+				(unsigned long long)st.retries, (unsigned long long)st.timeouts,
+				(unsigned long long)st.stalls, (unsigned long long)st.dropped,
+				srv->rate->period, GhRateReason(srv->rate->reason), srv->nclients,
+				srv->requests, srv->rejected);
+	}
+	else
+	{
+		GhCmdReply(c, "err unknown request\n");
+	}
+}
+
+/** @brief Sends what is queued, then runs the next buffered request.
+ *  @details One request is answered completely, history included, before
+ *           the next one is read, so replies never interleave.
+ */
+static void GhCmdService(cmdclient_s * c)
+{
+	size_t budget = GHCMDBUDGET;
+	uint32_t events;
+	char * nl;
+	ssize_t n;
+
+	while (budget > 0)
+	{
+		if (c->outpos < c->outlen)
+		{
+			n = send(c->fd, c->out + c->outpos, c->outlen - c->outpos, MSG_NOSIGNAL);
+			if (n < 0)
+			{
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					break;
+				}
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				GhCmdDrop(c);
+				return;
+			}
+			c->outpos += n;
+			budget = (size_t)n < budget ? budget - n : 0;
+			continue;
+		}
+		c->outpos = c->outlen = 0;
+		if (c->streaming)
+		{
+			GhCmdFill(c);
+			continue;
+		}
+		nl = (char *)memchr(c->in, '\n', c->inlen);
+		if (nl == NULL)
+		{
+			if (c->inlen == sizeof(c->in))
+			{
+				// Answer once, then throw the rest away up to its newline
+				if (!c->skipping)
+				{
+					GhCmdReply(c, "err request too long\n");
+				}
+				c->skipping = 1;
+				c->inlen = 0;
+				continue;
+			}
+			break;
+		}
+		*nl = 0;
+		if (c->skipping)
+		{
+			c->skipping = 0;
+		}
+		else
+		{
+			GhCmdExecute(c, c->in);
+		}
+		c->inlen -= nl + 1 - c->in;
+		memmove(c->in, nl + 1, c->inlen);
+	}
+	// Only ask for output readiness while there is something left to do
+	events = 0;
+	if (c->inlen < sizeof(c->in))
+	{
+		events |= EPOLLIN;
+	}
+	if (c->outpos < c->outlen || c->streaming || memchr(c->in, '\n', c->inlen) != NULL)
+	{
+		events |= EPOLLOUT;
+	}
+	GhSchedModFd(c->srv->sch, c->fd, events);
+}
+
+static void GhCmdClient(int fd, uint32_t events, void * arg)
+{
+	cmdclient_s * c = (cmdclient_s *)arg;
+	ssize_t n;
+
+	if (events & EPOLLIN)
+	{
+		n = recv(fd, c->in + c->inlen, sizeof(c->in) - c->inlen, 0);
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		{
+			GhCmdDrop(c);
+			return;
+		}
+		if (n > 0)
+		{
+			c->inlen += n;
+		}
+	}
+	else if (events & (EPOLLHUP | EPOLLERR))
+	{
+		GhCmdDrop(c);
+		return;
+	}
+	GhCmdService(c);
+}
+
+static void GhCmdAccept(int fd, uint32_t events, void * arg)
+{
+	cmdserver_s * srv = (cmdserver_s *)arg;
+	cmdclient_s * c;
+	int cfd, i;
+
+	while ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		c = NULL;
+		for (i = 0; i < GHCMDMAXCLIENTS; i++)
+		{
+			if (srv->client[i].fd < 0)
+			{
+				c = &srv->client[i];
+				break;
+			}
+		}
+		if (c == NULL || !GhSchedAddFd(srv->sch, cfd, EPOLLIN, GhCmdClient, c))
+		{
+			srv->rejected++;
+			close(cfd);
+			continue;
+		}
+		memset(c, 0, sizeof(*c));
+		c->fd = cfd;
+		c->srv = srv;
+		srv->nclients++;
+	}
+}
+
+/** @brief Listens on path and serves clients from the scheduler loop.
+ *  @details The caller fills in rd, sets, ring, rate, logname and apply
+ *           before running the scheduler.
+ *  @return 1 on success, 0 if the socket can't be set up
+ */
+int GhCmdOpen(cmdserver_s * srv, sched_s * sch, const char * path)
+{
+	struct sockaddr_un addr;
+	int i;
+
+	memset(srv, 0, sizeof(*srv));
+	srv->fd = -1;
+	for (i = 0; i < GHCMDMAXCLIENTS; i++)
+	{
+		srv->client[i].fd = -1;
+	}
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		return 0;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	srv->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (srv->fd < 0)
+	{
+		return 0;
+	}
+	// A controller that crashed leaves its socket file behind
+	unlink(path);
+	if (bind(srv->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| chmod(path, 0660) < 0
+			|| listen(srv->fd, GHCMDBACKLOG) < 0
+			|| !GhSchedAddFd(sch, srv->fd, EPOLLIN, GhCmdAccept, srv))
+	{
+		close(srv->fd);
+		srv->fd = -1;
+		unlink(path);
+		return 0;
+	}
+	srv->sch = sch;
+	srv->path = path;
+	return 1;
+}
+
+void GhCmdClose(cmdserver_s * srv)
+{
+	int i;
+
+	if (srv->fd < 0)
+	{
+		return;
+	}
+	for (i = 0; i < GHCMDMAXCLIENTS; i++)
+	{
+		if (srv->client[i].fd >= 0)
+		{
+			GhCmdDrop(&srv->client[i]);
+		}
+	}
+	GhSchedDelFd(srv->sch, srv->fd);
+	close(srv->fd);
+	unlink(srv->path);
+	srv->fd = -1;
+}
@@ -0,0 +1,76 @@
+/** @brief Gh command socket constants, structures, function prototypes
+ *  @file ghcmd.h
+ */
+
+#ifndef GHCMD_H
+#define GHCMD_H
+
+// Includes
+//
+#include <stddef.h>
+#include <stdint.h>
+#include "ghcontrol.h"
+#include "ghhist.h"
+#include "ghrate.h"
+#include "ghring.h"
+#include "ghsched.h"
+
+// Constants
+
+#define GHCMDPATH "ghcontrol.sock"
+#define GHCMDMAXCLIENTS 32
+#define GHCMDBACKLOG 16
+#define GHCMDLINESZ 128
+#define GHCMDOUTSZ 4096
+#define GHCMDROWSZ 80
+#define GHCMDBUDGET GHCMDOUTSZ
+#define GHCMDMAXROWS 100000
+
+// Structures
+
+typedef void (*ghsetpoints_fn)(setpoint_s sets, void * arg);
+
+struct cmdserver;
+
+typedef struct cmdclient
+{
+	int fd;
+	struct cmdserver * srv;
+	size_t inlen;
+	char in[GHCMDLINESZ];
+	int skipping;
+	size_t outpos;
+	size_t outlen;
+	char out[GHCMDOUTSZ];
+	int streaming;
+	histcursor_s hc;
+	size_t rows;
+	size_t maxrows;
+}cmdclient_s;
+
+typedef struct cmdserver
+{
+	int fd;
+	sched_s * sch;
+	const char * path;
+	const char * logname;
+	const reading_s * rd;
+	const setpoint_s * sets;
+	const ring_s * ring;
+	const ratepolicy_s * rate;
+	ghsetpoints_fn apply;
+	void * arg;
+	int nclients;
+	unsigned long requests;
+	unsigned long rejected;
+	cmdclient_s client[GHCMDMAXCLIENTS];
+}cmdserver_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+int GhCmdOpen(cmdserver_s * srv, sched_s * sch, const char * path);
+void GhCmdClose(cmdserver_s * srv);
+
+///@endcond
+#endif
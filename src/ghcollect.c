@@ -0,0 +1,608 @@
+/** @brief ghcollect: site collector for many greenhouse stations
+ *  @file ghcollect.c
+ *  @details ghcollect [-s shards] [-n stations] [-g group] [-i ifaddr] [-p feedport] [-q queryport]
+ *
+ *           Hears the multicast records controllers send (ghmcast.c) and
+ *           takes the same 44-byte records back to back over TCP on feedport
+ *           from stations that can't reach the group. Records go to a
+ *           ghstation store sharded over worker threads; this thread only
+ *           receives and queues, and answers text queries on queryport:
+ *
+ *               stats                  ok stations=... records=... processed=... ...
+ *               zones                  ok, then one line per zone with stations:
+ *                                      "<zone> <stations> <silent>" and min, mean,
+ *                                      max of temperature, humidity, pressure,
+ *                                      then "end <zones>"
+ *               station <id> [count]   ok <zone> <records> <lost> <age ms>, then
+ *                                      the station's recent readings in the
+ *                                      ghdata.txt format, then "end <rows>"
+ *
+ *           The store is sized for -n stations (GHSTATIONEXPECT by
+ *           default); records from stations beyond what a shard holds are
+ *           counted as full. Station ids are serial numbers in hex. Anything else gets
+ *           "err <why>". A line with the totals goes to stdout every
+ *           GHCOLLECTREPORT ms.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ghmcast.h"
+#include "ghsched.h"
+#include "ghstation.h"
+
+#define GHCOLLECTADDR "0.0.0.0"
+#define GHCOLLECTPORT 4300
+#define GHCOLLECTQUERYPORT 4301
+#define GHCOLLECTBACKLOG 16
+#define GHCOLLECTMAXFEEDS 64
+#define GHCOLLECTMAXQUERIES 16
+#define GHCOLLECTFEEDSZ (GHMCASTBATCH * GHMCASTRECSZ)
+#define GHCOLLECTREADS 16
+#define GHCOLLECTLINESZ 128
+#define GHCOLLECTOUTSZ 32768
+#define GHCOLLECTREPORT 10000
+
+typedef struct feed
+{
+	int fd;
+	size_t len;
+	uint8_t buf[GHCOLLECTFEEDSZ];
+}feed_s;
+
+typedef struct query
+{
+	int fd;
+	size_t inlen;
+	char in[GHCOLLECTLINESZ];
+	int skipping;
+	size_t outpos;
+	size_t outlen;
+	char out[GHCOLLECTOUTSZ];
+}query_s;
+
+typedef struct collector
+{
+	sched_s sch;
+	stationstore_s store;
+	mcastreceiver_s mr;
+	int feedfd;
+	int queryfd;
+	int nfeeds;
+	int nqueries;
+	unsigned long records;
+	unsigned long bad;
+	unsigned long rejected;
+	unsigned long requests;
+	uint64_t lastprocessed;
+	int64_t lastreport;
+	feed_s feed[GHCOLLECTMAXFEEDS];
+	query_s query[GHCOLLECTMAXQUERIES];
+}collector_s;
+
+static collector_s gc;
+
+static int GhCollectListen(const char * addr, int port)
+{
+	struct sockaddr_in sin;
+	int fd, on = 1;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1)
+	{
+		return -1;
+	}
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 || listen(fd, GHCOLLECTBACKLOG) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void GhCollectRecord(const mcastrecord_s * rec, void * arg)
+{
+	GhStationPut(&((collector_s *)arg)->store, rec);
+}
+
+static void GhCollectMcast(int fd, uint32_t events, void * arg)
+{
+	collector_s * cl = (collector_s *)arg;
+	int i;
+
+	// Level-triggered: anything left after the budget wakes us again
+	for (i = 0; i < GHCOLLECTREADS; i++)
+	{
+		if (GhMcastReceive(&cl->mr, GhCollectRecord, cl) < GHMCASTBATCH)
+		{
+			break;
+		}
+	}
+}
+
+static void GhCollectFeedDrop(feed_s * f)
+{
+	GhSchedDelFd(&gc.sch, f->fd);
+	close(f->fd);
+	f->fd = -1;
+	gc.nfeeds--;
+}
+
+static void GhCollectFeed(int fd, uint32_t events, void * arg)
+{
+	feed_s * f = (feed_s *)arg;
+	mcastrecord_s rec;
+	size_t off;
+	ssize_t n;
+	int i;
+
+	for (i = 0; i < GHCOLLECTREADS; i++)
+	{
+		n = recv(fd, f->buf + f->len, sizeof(f->buf) - f->len, 0);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		{
+			return;
+		}
+		if (n <= 0)
+		{
+			GhCollectFeedDrop(f);
+			return;
+		}
+		f->len += n;
+		for (off = 0; off + GHMCASTRECSZ <= f->len; off += GHMCASTRECSZ)
+		{
+			// Past a bad record the stream is out of step; start over
+			if (!GhMcastDecode(f->buf + off, GHMCASTRECSZ, &rec))
+			{
+				gc.bad++;
+				GhCollectFeedDrop(f);
+				return;
+			}
+			gc.records++;
+			GhStationPut(&gc.store, &rec);
+		}
+		f->len -= off;
+		memmove(f->buf, f->buf + off, f->len);
+	}
+}
+
+static void GhCollectFeedAccept(int fd, uint32_t events, void * arg)
+{
+	collector_s * cl = (collector_s *)arg;
+	feed_s * f;
+	int cfd, i;
+
+	while ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		f = NULL;
+		for (i = 0; i < GHCOLLECTMAXFEEDS; i++)
+		{
+			if (cl->feed[i].fd < 0)
+			{
+				f = &cl->feed[i];
+				break;
+			}
+		}
+		if (f == NULL || !GhSchedAddFd(&cl->sch, cfd, EPOLLIN, GhCollectFeed, f))
+		{
+			cl->rejected++;
+			close(cfd);
+			continue;
+		}
+		f->fd = cfd;
+		f->len = 0;
+		cl->nfeeds++;
+	}
+}
+
+static void GhCollectQueryDrop(query_s * q)
+{
+	GhSchedDelFd(&gc.sch, q->fd);
+	close(q->fd);
+	q->fd = -1;
+	gc.nqueries--;
+}
+
+static void GhCollectReply(query_s * q, const char * fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void GhCollectReply(query_s * q, const char * fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(q->out + q->outlen, sizeof(q->out) - q->outlen, fmt, ap);
+	va_end(ap);
+	if (n > 0)
+	{
+		q->outlen += (size_t)n < sizeof(q->out) - q->outlen ? (size_t)n : sizeof(q->out) - q->outlen - 1;
+	}
+}
+
+static void GhCollectStats(query_s * q)
+{
+	stationtotals_s tot;
+
+	GhStationTotals(&gc.store, &tot);
+	GhCollectReply(q, "ok stations=%llu records=%lu processed=%llu dropped=%llu lost=%llu full=%llu"
+			" bad=%lu udpbad=%lu shards=%d feeds=%d queries=%d requests=%lu rejected=%lu\n",
+			(unsigned long long)tot.stations, gc.records + gc.mr.records,
+			(unsigned long long)tot.processed, (unsigned long long)tot.dropped,
+			(unsigned long long)tot.lost, (unsigned long long)tot.full, gc.bad, gc.mr.bad,
+			gc.store.nshards, gc.nfeeds, gc.nqueries, gc.requests, gc.rejected);
+}
+
+static void GhCollectZones(query_s * q)
+{
+	static zoneagg_s zones[GHSTATIONZONES];
+	const zoneagg_s * za;
+	float lo[SENSORS], mean[SENSORS], hi[SENSORS];
+	int z, k, n = 0;
+
+	GhStationZones(&gc.store, zones);
+	GhCollectReply(q, "ok\n");
+	for (z = 0; z < GHSTATIONZONES; z++)
+	{
+		za = &zones[z];
+		if (za->stations == 0)
+		{
+			continue;
+		}
+		for (k = 0; k < SENSORS; k++)
+		{
+			lo[k] = za->count[k] > 0 ? za->min[k] : NAN;
+			mean[k] = za->count[k] > 0 ? za->sum[k] / za->count[k] : NAN;
+			hi[k] = za->count[k] > 0 ? za->max[k] : NAN;
+		}
+		GhCollectReply(q, "%d %u %u %.1f %.1f %.1f %.1f %.1f %.1f %.1f %.1f %.1f\n",
+				z, za->stations, za->silent,
+				lo[TEMPERATURE], mean[TEMPERATURE], hi[TEMPERATURE],
+				lo[HUMIDITY], mean[HUMIDITY], hi[HUMIDITY],
+				lo[PRESSURE], mean[PRESSURE], hi[PRESSURE]);
+		n++;
+	}
+	GhCollectReply(q, "end %d\n", n);
+}
+
+static void GhCollectStation(query_s * q, uint64_t id, size_t count)
+{
+	stationsample_s s[GHSTATIONHIST];
+	char ltime[CTIMESTRSZ + 1];
+	const station_s * st;
+	time_t rtime;
+	size_t i, n;
+
+	st = GhStationFind(&gc.store, id);
+	if (st == NULL)
+	{
+		GhCollectReply(q, "err unknown station\n");
+		return;
+	}
+	n = GhStationRecent(st, s, count);
+	GhCollectReply(q, "ok %d %llu %llu %.1f\n", __atomic_load_n(&st->zone, __ATOMIC_RELAXED),
+			(unsigned long long)__atomic_load_n(&st->records, __ATOMIC_RELAXED),
+			(unsigned long long)__atomic_load_n(&st->lost, __ATOMIC_RELAXED),
+			(GhSchedNow() - __atomic_load_n(&st->heard, __ATOMIC_RELAXED)) / 1e6);
+	for (i = 0; i < n; i++)
+	{
+		// Same row layout as GhLogData()
+		rtime = (time_t)(s[i].ntime / GHNSPERSEC);
+		ctime_r(&rtime, ltime);
+		ltime[3] = ',';
+		ltime[7] = ',';
+		ltime[10] = ',';
+		ltime[19] = ',';
+		GhCollectReply(q, "%.24s,%5.1lf,%5.1lf,%6.1lf\n", ltime,
+				s[i].temperature, s[i].humidity, s[i].pressure);
+	}
+	GhCollectReply(q, "end %zu\n", n);
+}
+
+static void GhCollectExecute(query_s * q, char * line)
+{
+	char * argv[3];
+	char * save;
+	char * end;
+	uint64_t id;
+	long count;
+	int argc;
+
+	for (argc = 0; argc < 3; argc++)
+	{
+		argv[argc] = strtok_r(argc == 0 ? line : NULL, " \t\r", &save);
+		if (argv[argc] == NULL)
+		{
+			break;
+		}
+	}
+	gc.requests++;
+	if (argc == 0)
+	{
+		GhCollectReply(q, "err empty request\n");
+	}
+	else if (strcmp(argv[0], "stats") == 0 && argc == 1)
+	{
+		GhCollectStats(q);
+	}
+	else if (strcmp(argv[0], "zones") == 0 && argc == 1)
+	{
+		GhCollectZones(q);
+	}
+	else if (strcmp(argv[0], "station") == 0 && (argc == 2 || argc == 3))
+	{
+		id = strtoull(argv[1], &end, 16);
+		count = argc == 3 ? strtol(argv[2], NULL, 10) : GHSTATIONHIST;
+		if (*end != '\0' || end == argv[1])
+		{
+			GhCollectReply(q, "err bad station id\n");
+		}
+		else
+		{
+			GhCollectStation(q, id, count > 0 && count < GHSTATIONHIST ? count : GHSTATIONHIST);
+		}
+	}
+	else
+	{
+		GhCollectReply(q, "err unknown request\n");
+	}
+}
+
+/** @brief Sends what is queued, then answers the next buffered request.
+ */
+static void GhCollectService(query_s * q)
+{
+	uint32_t events;
+	char * nl;
+	ssize_t n;
+
+	for (;;)
+	{
+		if (q->outpos < q->outlen)
+		{
+			n = send(q->fd, q->out + q->outpos, q->outlen - q->outpos, MSG_NOSIGNAL);
+			if (n < 0)
+			{
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					break;
+				}
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				GhCollectQueryDrop(q);
+				return;
+			}
+			q->outpos += n;
+			continue;
+		}
+		q->outpos = q->outlen = 0;
+		nl = (char *)memchr(q->in, '\n', q->inlen);
+		if (nl == NULL)
+		{
+			if (q->inlen == sizeof(q->in))
+			{
+				if (!q->skipping)
+				{
+					GhCollectReply(q, "err request too long\n");
+				}
+				q->skipping = 1;
+				q->inlen = 0;
+				continue;
+			}
+			break;
+		}
+		*nl = 0;
+		if (q->skipping)
+		{
+			q->skipping = 0;
+		}
+		else
+		{
+			GhCollectExecute(q, q->in);
+		}
+		q->inlen -= nl + 1 - q->in;
+		memmove(q->in, nl + 1, q->inlen);
+	}
+	events = EPOLLIN;
+	if (q->outpos < q->outlen)
+	{
+		// Stop reading until the reply is out
+		events = EPOLLOUT;
+	}
+	GhSchedModFd(&gc.sch, q->fd, events);
+}
+
+static void GhCollectQuery(int fd, uint32_t events, void * arg)
+{
+	query_s * q = (query_s *)arg;
+	ssize_t n;
+
+	if ((events & EPOLLIN) && q->inlen < sizeof(q->in))
+	{
+		n = recv(fd, q->in + q->inlen, sizeof(q->in) - q->inlen, 0);
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		{
+			GhCollectQueryDrop(q);
+			return;
+		}
+		if (n > 0)
+		{
+			q->inlen += n;
+		}
+	}
+	else if (events & (EPOLLHUP | EPOLLERR))
+	{
+		GhCollectQueryDrop(q);
+		return;
+	}
+	GhCollectService(q);
+}
+
+static void GhCollectQueryAccept(int fd, uint32_t events, void * arg)
+{
+	collector_s * cl = (collector_s *)arg;
+	query_s * q;
+	int cfd, i;
+
+	while ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		q = NULL;
+		for (i = 0; i < GHCOLLECTMAXQUERIES; i++)
+		{
+			if (cl->query[i].fd < 0)
+			{
+				q = &cl->query[i];
+				break;
+			}
+		}
+		if (q == NULL || !GhSchedAddFd(&cl->sch, cfd, EPOLLIN, GhCollectQuery, q))
+		{
+			cl->rejected++;
+			close(cfd);
+			continue;
+		}
+		q->fd = cfd;
+		q->inlen = q->outpos = q->outlen = 0;
+		q->skipping = 0;
+		cl->nqueries++;
+	}
+}
+
+static void GhCollectReport(void * arg)
+{
+	collector_s * cl = (collector_s *)arg;
+	stationtotals_s tot;
+	int64_t now;
+
+	now = GhSchedNow();
+	GhStationTotals(&cl->store, &tot);
+	fprintf(stdout, "Stations: %llu\tRecords/s: %.0f\tDropped: %llu\tLost: %llu\tFull: %llu\tBad: %lu\n",
+			(unsigned long long)tot.stations,
+			now > cl->lastreport ? (tot.processed - cl->lastprocessed) * 1e9 / (now - cl->lastreport) : 0.0,
+			(unsigned long long)tot.dropped, (unsigned long long)tot.lost,
+			(unsigned long long)tot.full, cl->bad + cl->mr.bad);
+	fflush(stdout);
+	cl->lastprocessed = tot.processed;
+	cl->lastreport = now;
+}
+
+int main(int argc, char * argv[])
+{
+	const char * group = GHMCASTGROUP;
+	const char * ifaddr = NULL;
+	int shards = GHSTATIONSHARDS, port = GHCOLLECTPORT, qport = GHCOLLECTQUERYPORT;
+	unsigned long long stations = GHSTATIONEXPECT;
+	int i, opt, stopped;
+
+	while ((opt = getopt(argc, argv, "s:n:g:i:p:q:")) != -1)
+	{
+		switch (opt)
+		{
+		case 's':
+			shards = atoi(optarg);
+			break;
+		case 'n':
+			stations = strtoull(optarg, NULL, 10);
+			break;
+		case 'g':
+			group = optarg;
+			break;
+		case 'i':
+			ifaddr = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'q':
+			qport = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s shards] [-n stations] [-g group] [-i ifaddr] [-p feedport] [-q queryport]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	for (i = 0; i < GHCOLLECTMAXFEEDS; i++)
+	{
+		gc.feed[i].fd = -1;
+	}
+	for (i = 0; i < GHCOLLECTMAXQUERIES; i++)
+	{
+		gc.query[i].fd = -1;
+	}
+	gc.mr.fd = -1;
+	gc.feedfd = gc.queryfd = -1;
+	// The scheduler blocks SIGINT and SIGTERM; workers inherit the mask
+	if (!GhSchedInit(&gc.sch))
+	{
+		fprintf(stderr, "Can't create scheduler\n");
+		return EXIT_FAILURE;
+	}
+	if (!GhStationStart(&gc.store, shards, stations))
+	{
+		fprintf(stderr, "Can't start %d shards for %llu stations\n", shards, stations);
+		GhSchedClose(&gc.sch);
+		return EXIT_FAILURE;
+	}
+	if (!GhMcastListen(&gc.mr, group, GHMCASTPORT, ifaddr)
+			|| !GhSchedAddFd(&gc.sch, gc.mr.fd, EPOLLIN, GhCollectMcast, &gc))
+	{
+		fprintf(stderr, "Can't join multicast group %s:%d\n", group, GHMCASTPORT);
+	}
+	gc.feedfd = GhCollectListen(GHCOLLECTADDR, port);
+	if (gc.feedfd < 0 || !GhSchedAddFd(&gc.sch, gc.feedfd, EPOLLIN, GhCollectFeedAccept, &gc))
+	{
+		fprintf(stderr, "Can't listen for feeds on port %d\n", port);
+	}
+	gc.queryfd = GhCollectListen(GHCOLLECTADDR, qport);
+	if (gc.queryfd < 0 || !GhSchedAddFd(&gc.sch, gc.queryfd, EPOLLIN, GhCollectQueryAccept, &gc))
+	{
+		fprintf(stderr, "Can't listen for queries on port %d\n", qport);
+	}
+	gc.lastreport = GhSchedNow();
+	GhSchedAddTask(&gc.sch, "report", GHCOLLECTREPORT, GhCollectReport, &gc);
+	stopped = GhSchedRun(&gc.sch);
+	for (i = 0; i < GHCOLLECTMAXQUERIES; i++)
+	{
+		if (gc.query[i].fd >= 0)
+		{
+			GhCollectQueryDrop(&gc.query[i]);
+		}
+	}
+	for (i = 0; i < GHCOLLECTMAXFEEDS; i++)
+	{
+		if (gc.feed[i].fd >= 0)
+		{
+			GhCollectFeedDrop(&gc.feed[i]);
+		}
+	}
+	if (gc.queryfd >= 0)
+	{
+		close(gc.queryfd);
+	}
+	if (gc.feedfd >= 0)
+	{
+		close(gc.feedfd);
+	}
+	GhMcastUnlisten(&gc.mr);
+	GhStationStop(&gc.store);
+	GhSchedClose(&gc.sch);
+	return stopped ? EXIT_SUCCESS : EXIT_FAILURE;
+}
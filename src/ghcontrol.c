@@ -3,14 +3,43 @@
  */
 #include "ghcontrol.h"
 #include "sensehat.h"
+#include "ghlog.h"
+#include "ghhist.h"
+#include "ghblock.h"
+#include "ghsample.h"
 #include <cstring>
 #include <string.h>
+#include <errno.h>
 
 #if SENSEHAT
 SenseHat Sh;
 #endif
+static logger_s ghlog = {-1};
+#if GHLOGCOLUMNS
+static histwriter_s ghhist = {{-1, -1, -1, -1}};
+#endif
+#if GHLOGBLOCKS
+static blockwriter_s ghblock = {-1};
+#endif
+#if !SIMULATE && GHOVERSAMPLE
+static sampler_s ghsampler;
+#endif
+static int64_t ghlastntime;
 
-int GhSetVerticalBar(int bar, COLOR_SENSEHAT pxc, uint8_t value)
+static void GhSetPixel(uint16_t frame[8][8], int row, int column, COLOR_SENSEHAT pxc)
+{
+	if (row < 0)
+	{
+		row = 0;
+	}
+	if (column < 0)
+	{
+		column = 0;
+	}
+	frame[row % 8][column % 8] = pxc;
+}
+
+int GhSetVerticalBar(uint16_t frame[8][8], int bar, COLOR_SENSEHAT pxc, uint8_t value)
 {
 
 	int i;
@@ -23,11 +52,11 @@ int GhSetVerticalBar(int bar, COLOR_SENSEHAT pxc, uint8_t value)
 	{
 		for (i = 0; i <= value; i++)
 		{
-			Sh.LightPixel(i, bar, pxc);
+			GhSetPixel(frame, i, bar, pxc);
 		}
 		for (i = value + 1; i < 8; i++)
 		{
-			Sh.LightPixel(i, bar, BLACK);
+			GhSetPixel(frame, i, bar, BLACK);
 		}
 		return EXIT_SUCCESS;
 	}
@@ -37,27 +66,28 @@ int GhSetVerticalBar(int bar, COLOR_SENSEHAT pxc, uint8_t value)
 void GhDisplayAll(reading_s rd, setpoint_s sd)
 {
 
-	int rv, sv, avh, avl;
-
-	// Clear the display
-	Sh.WipeScreen();
+	int rv, sv;
+	uint16_t frame[8][8] = {{BLACK}};
 
 	// Temperature
 	rv = (int)(8.0 * (((rd.temperature - LSTEMP) / (USTEMP - LSTEMP)) + 0.05)) - 1;
 	sv = (int)(8.0 * (((sd.temperature - LSTEMP) / (USTEMP - LSTEMP)) + 0.05)) - 1;
-	GhSetVerticalBar(TBAR, GREEN, rv);
-	Sh.LightPixel(sv, TBAR, MAGENTA);
+	GhSetVerticalBar(frame, TBAR, GREEN, rv);
+	GhSetPixel(frame, sv, TBAR, MAGENTA);
 
 	// HUmidity
 	rv = (int)(8.0 * (((rd.humidity - LSHUMID) / (USHUMID - LSHUMID)) + 0.05)) - 1;
 	sv = (int)(8.0 * (((sd.humidity - LSHUMID) / (USHUMID - LSHUMID)) + 0.05)) - 1;
-	GhSetVerticalBar(HBAR, GREEN, rv);
-	Sh.LightPixel(sv, HBAR, MAGENTA);
+	GhSetVerticalBar(frame, HBAR, GREEN, rv);
+	GhSetPixel(frame, sv, HBAR, MAGENTA);
 
 	// Pressure
 	rv = (int)(8.0 * (((rd.pressure - LSPRESS) / (USPRESS - LSPRESS)) + 0.05)) - 1;
 
-	GhSetVerticalBar(PBAR, GREEN, rv);
+	GhSetVerticalBar(frame, PBAR, GREEN, rv);
+
+	// The display thread shows the bars whenever no message is scrolling
+	Sh.SetIdlePattern(frame);
 }
 
 int GhSaveSetpoints(const char *fname, setpoint_s spts)
@@ -98,24 +128,52 @@ setpoint_s GhRetrieveSetpoints(const char *fname)
 
 int GhLogData(const char *fname, reading_s ghdata)
 {
-	FILE *fp;
-	char ltime[CTIMESTRSZ];
-
-	fp = fopen(fname, "a");
-	if (fp == NULL)
+	if (ghlog.fd < 0 || strcmp(ghlog.fname, fname) != 0)
 	{
-		fprintf(stdout, "\nCan't open file, data not retrived!\n");
-		return 0;
+		GhLogClose(&ghlog);
+		if (!GhLogOpen(&ghlog, fname, GHLOGFLUSHSZ, GHLOGFLUSHAGE, GHLOGFSYNC))
+		{
+			fprintf(stdout, "\nCan't open file, data not retrived!\n");
+			return 0;
+		}
+#if GHLOGCOLUMNS
+		GhHistClose(&ghhist);
+		if (!GhHistOpen(&ghhist, fname))
+		{
+			fprintf(stdout, "\nCan't open history columns for %s\n", fname);
+		}
+#endif
+#if GHLOGBLOCKS
+		GhBlockClose(&ghblock);
+		if (!GhBlockOpen(&ghblock, fname))
+		{
+			fprintf(stdout, "\nCan't open history blocks for %s\n", fname);
+		}
+#endif
 	}
-	strcpy(ltime, ctime(&ghdata.rtime));
-	ltime[3] = ',';
-	ltime[7] = ',';
-	ltime[10] = ',';
-	ltime[19] = ',';
-	fprintf(fp, "\n%.24s,%5.1lf,%5.1lf,%6.1lf", ltime, ghdata.temperature, ghdata.humidity, ghdata.pressure);
+#if GHLOGCOLUMNS
+	GhHistAppend(&ghhist, ghdata);
+#endif
+#if GHLOGBLOCKS
+	GhBlockAppend(&ghblock, ghdata);
+#endif
+	return GhLogAppend(&ghlog, ghdata);
+}
 
-	fclose(fp);
-	return 1;
+/** @brief Applies a new update period to the sampler and records it in the
+ *         .rate file next to the log.
+ *  @details The sampler rate scales with the period so each update still
+ *           decimates about the same number of samples, down to 1 Hz.
+ */
+void GhSetUpdatePeriod(const char *fname, time_t rtime, int period, const char *reason)
+{
+#if !SIMULATE && GHOVERSAMPLE
+	int rate;
+
+	rate = GHSAMPLERATE * GHUPDATE / period;
+	GhSamplerSetRate(&ghsampler, rate < 1 ? 1 : rate > GHSAMPLERATE ? GHSAMPLERATE : rate);
+#endif
+	GhLogRate(fname, rtime, period, reason);
 }
 
 void GhDisplayHeader(const char *sname)
@@ -169,27 +227,75 @@ int GhGetRandom(int range)
 
 void GhDelay(int milliseconds)
 {
-	long wait;
-	clock_t now, start;
+	struct timespec wait;
 
-	wait = milliseconds * (CLOCKS_PER_SEC / 1000);
-	start = clock();
-	now = start;
-	while ((now - start) < wait)
+	wait.tv_sec = milliseconds / 1000;
+	wait.tv_nsec = (milliseconds % 1000) * 1000000L;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &wait, &wait) == EINTR)
 	{
-		now = clock();
 	}
 }
 
+#if !SIMULATE && GHOVERSAMPLE
+static int GhSampleSensors(sample_s * sp, void * arg)
+{
+	EnvSample env;
+
+	env = Sh.ReadEnvironment();
+	sp->mtime = env.mtime;
+	sp->temperature = env.temperature;
+	sp->humidity = env.humidity;
+	sp->pressure = env.pressure;
+	// Nothing answered: let the sampler retry
+	return !(isnan(env.temperature) && isnan(env.humidity) && isnan(env.pressure));
+}
+#endif
+
 void GhControllerInit(void)
 {
 	srand((unsigned)time(NULL));
+#if SENSEHAT && !SIMULATE
+	// The rest of the HAT keeps coming up in the background
+	if (!Sh.SensorsReady().get())
+	{
+		fprintf(stdout, "\nEnvironmental sensors not found\n");
+	}
+#endif
+#if !SIMULATE && GHOVERSAMPLE
+	if (!GhSamplerStart(&ghsampler, GHSAMPLERATE, GHSAMPLEMETHOD, GhSampleSensors, NULL))
+	{
+		fprintf(stdout, "\nCan't start sampler, reading sensors once per update\n");
+	}
+#endif
+}
+
+void GhControllerShutdown(void)
+{
+#if !SIMULATE && GHOVERSAMPLE
+	GhSamplerStop(&ghsampler);
+#endif
+	GhLogClose(&ghlog);
+#if GHLOGCOLUMNS
+	GhHistClose(&ghhist);
+#endif
+#if GHLOGBLOCKS
+	GhBlockClose(&ghblock);
+#endif
 }
 
 void GhDisplayReadings(reading_s rdata)
 {
 	fprintf(stdout, "\n%s Readings\tT: %5.1fC\tH: %5.1f%%\tP: %6.1fmB\n",
 			ctime(&rdata.rtime), rdata.temperature, rdata.humidity, rdata.pressure);
+	if (rdata.sampled != 0)
+	{
+		fprintf(stdout, " Age\t\t%.1fms\n", (GhMonoNow() - rdata.sampled) / 1e6);
+	}
+	if (rdata.stale)
+	{
+		fprintf(stdout, " Stale\t\tT: %d\tH: %d\tP: %d\n", (rdata.stale >> TEMPERATURE) & 1,
+				(rdata.stale >> HUMIDITY) & 1, (rdata.stale >> PRESSURE) & 1);
+	}
 }
 
 void GhDisplayControls(control_s ctrl)
@@ -250,17 +356,164 @@ float GhGetTemperature(void)
 #endif
 }
 
+/** @brief CLOCK_MONOTONIC in nanoseconds.
+ */
+int64_t GhMonoNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * GHNSPERSEC + ts.tv_nsec;
+}
+
+/** @brief Realtime nanoseconds of a monotonic time, with the clocks'
+ *         current offset.
+ */
+int64_t GhMonoToReal(int64_t mtime)
+{
+	struct timespec real, mono;
+
+	clock_gettime(CLOCK_REALTIME, &real);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	return mtime + ((int64_t)real.tv_sec - mono.tv_sec) * GHNSPERSEC + (real.tv_nsec - mono.tv_nsec);
+}
+
+/** @brief Sets a reading's monotonic time and the realtime it maps to.
+ *  @details The offset is measured again for every reading, so an NTP step
+ *           shows up at the next one. The realtime never goes backwards:
+ *           after a step back it holds until the clock catches up, so
+ *           readings stay in order in the log and history. rtime is the
+ *           same instant in whole seconds, as the CSV log has always had.
+ */
+void GhStampReading(reading_s * rd, int64_t mtime)
+{
+	rd->mtime = mtime;
+	rd->ntime = GhMonoToReal(mtime);
+	if (rd->ntime <= ghlastntime)
+	{
+		rd->ntime = ghlastntime + 1;
+	}
+	ghlastntime = rd->ntime;
+	rd->rtime = (time_t)(rd->ntime / GHNSPERSEC);
+}
+
 reading_s GhGetReadings(void)
 {
 	reading_s now;
-
-	now.rtime = time(NULL);
+#if SIMULATE
+	GhStampReading(&now, GhMonoNow());
+	now.sampled = now.mtime;
 	now.temperature = GhGetTemperature();
 	now.humidity = GhGetHumidity();
 	now.pressure = GhGetPressure();
+	now.stale = 0;
+#else
+	EnvSample env;
+
+#if GHOVERSAMPLE
+	if (ghsampler.running)
+	{
+		// The update is stamped now; sampled says how old the values are
+		GhSamplerRead(&ghsampler, &now);
+		GhStampReading(&now, GhMonoNow());
+		return now;
+	}
+#endif
+	env = Sh.ReadEnvironment();
+	GhStampReading(&now, GhMonoNow());
+	now.temperature = env.temperature;
+	now.humidity = env.humidity;
+	now.pressure = env.pressure;
+	now.stale = (isnan(now.temperature) << TEMPERATURE) | (isnan(now.humidity) << HUMIDITY)
+			| (isnan(now.pressure) << PRESSURE);
+	now.sampled = now.stale == ((1 << TEMPERATURE) | (1 << HUMIDITY) | (1 << PRESSURE)) ? 0 : (int64_t)env.mtime;
+#endif
 	return now;
 }
 
+/** @brief Sensor health counters: samples, NaNs, retried and stalled reads,
+ *         and updates that had to reuse stale values.
+ */
+sensorstats_s GhGetSensorStats(void)
+{
+	sensorstats_s st;
+
+	memset(&st, 0, sizeof(st));
+#if !SIMULATE && GHOVERSAMPLE
+	if (ghsampler.running)
+	{
+		GhSamplerStats(&ghsampler, &st);
+	}
+#endif
+	return st;
+}
+
+int GhJoystickFd(void)
+{
+#if SENSEHAT
+	return Sh.JoystickFd();
+#else
+	return -1;
+#endif
+}
+
+/** @brief Applies queued joystick events to the setpoints.
+ *  @details Up/down step the temperature, right/left the humidity, with
+ *           auto-repeat while held. Enter saves them to setpoints.dat.
+ */
+setpoint_s GhEditSetpoints(setpoint_s spts)
+{
+#if SENSEHAT
+	JoystickEvent ev;
+
+	while (Sh.ReadJoystick(ev))
+	{
+		if (ev.type != JOYSTICK_PRESS && ev.type != JOYSTICK_REPEAT)
+		{
+			continue;
+		}
+		switch (ev.code)
+		{
+			case KEY_UP:
+				spts.temperature += TEMPSTEP;
+				break;
+			case KEY_DOWN:
+				spts.temperature -= TEMPSTEP;
+				break;
+			case KEY_RIGHT:
+				spts.humidity += HUMIDSTEP;
+				break;
+			case KEY_LEFT:
+				spts.humidity -= HUMIDSTEP;
+				break;
+			case KEY_ENTER:
+				if (ev.type == JOYSTICK_PRESS)
+				{
+					GhSaveSetpoints("setpoints.dat", spts);
+				}
+				break;
+		}
+		if (spts.temperature > USTEMP)
+		{
+			spts.temperature = USTEMP;
+		}
+		if (spts.temperature < LSTEMP)
+		{
+			spts.temperature = LSTEMP;
+		}
+		if (spts.humidity > USHUMID)
+		{
+			spts.humidity = USHUMID;
+		}
+		if (spts.humidity < LSHUMID)
+		{
+			spts.humidity = LSHUMID;
+		}
+	}
+#endif
+	return spts;
+}
+
 setpoint_s GhSetTargets(void)
 {
 	setpoint_s cpoints;
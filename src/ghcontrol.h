@@ -18,6 +18,9 @@
 #define SEARCHSTR "serial\t\t:"
 #define SYSINFOBUFSZ 512
 #define GHUPDATE 2000
+#define GHLOGUPDATE 2000
+#define GHDISPUPDATE 2000
+#define GHCONUPDATE 2000
 #define SENSORS 3
 #define TEMPERATURE 0
 #define HUMIDITY 1
@@ -31,6 +34,8 @@
 #define LSPRESS 975
 #define STEMP 25.0
 #define SHUMID 55.0
+#define TEMPSTEP 0.5
+#define HUMIDSTEP 1.0
 #define ON 1
 #define OFF 0
 #define CTIMESTRSZ 25
@@ -43,17 +48,38 @@
 #define SIMTEMPERATURE 0
 #define SIMHUMIDITY 0
 #define SIMPRESSURE 0
+#define GHLOGCOLUMNS 1
+#define GHLOGBLOCKS 1
+#define GHOVERSAMPLE 1
+#define GHMCAST 0
+#define GHZONE 0
+#define GHNSPERSEC 1000000000LL
 
 // Structures
 
 typedef struct readings
 {
 	time_t rtime;
+	int64_t mtime;
+	int64_t ntime;
+	// Monotonic time of the newest sample behind the values, 0 if none
+	int64_t sampled;
 	float temperature;
 	float humidity;
 	float pressure;
+	int stale;
 }reading_s;
 
+typedef struct sensorstats
+{
+	uint64_t samples;
+	uint64_t nans;
+	uint64_t retries;
+	uint64_t timeouts;
+	uint64_t stalls;
+	uint64_t dropped;
+}sensorstats_s;
+
 
 typedef struct setpoints
 {
@@ -75,21 +101,29 @@ u_int64_t GhGetSerial(void);
 int GhGetRandom(int range);
 void GhDelay(int milliseconds);
 int GhLogData(const char * fname, reading_s ghdata);
+void GhSetUpdatePeriod(const char * fname, time_t rtime, int period, const char * reason);
 void GhControllerInit(void);
+void GhControllerShutdown(void);
 void GhDisplayControls(control_s ctrl);
 void GhDisplayReadings(reading_s rdata);
 void GhDisplayTargets(setpoint_s spts);
 control_s GhSetControls(setpoint_s target,reading_s rdata);
 setpoint_s GhSetTargets(void);
 void GhDisplayAll(reading_s rd,setpoint_s sd);
-int GhSetVerticalBar(int bar, COLOR_SENSEHAT pxc, uint8_t value);
+int GhSetVerticalBar(uint16_t frame[8][8], int bar, COLOR_SENSEHAT pxc, uint8_t value);
 
 float GhGetHumidity(void);
 float GhGetPressure(void);
 float GhGetTemperature(void);
 reading_s GhGetReadings(void);
+int64_t GhMonoNow(void);
+int64_t GhMonoToReal(int64_t mtime);
+void GhStampReading(reading_s * rd, int64_t mtime);
+sensorstats_s GhGetSensorStats(void);
 int GhSaveSetpoints(const char * fname, setpoint_s spts);
 setpoint_s GhRetrieveSetpoints(const char * fname);
+int GhJoystickFd(void);
+setpoint_s GhEditSetpoints(setpoint_s spts);
 
 ///@endcond
 #endif
@@ -0,0 +1,406 @@
+/** @brief Gh columnar history writer and mmap reader
+ *  @file ghhist.c
+ *  @details Each field of reading_s lives in its own file next to the CSV
+ *           log (ghdata.time, ghdata.temp, ghdata.humid, ghdata.press),
+ *           beside the compressed blocks of ghblock.c. History queries read
+ *           the columns where they have the range and the blocks before.
+ *           A file is a histheader_s followed by packed native values, so a
+ *           mapped column can be used as a plain array. The readable row
+ *           count is the shortest column, which hides a torn batch. The
+ *           time column holds realtime nanoseconds (ntime).
+ */
+#include "ghhist.h"
+#include "ghlog.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char * const histsuffix[GHHISTCOLS] = {"time", "temp", "humid", "press"};
+static const uint16_t histelemsz[GHHISTCOLS] = {sizeof(int64_t), sizeof(float), sizeof(float), sizeof(float)};
+
+void GhHistColumnName(char * buf, size_t bufsz, const char * fname, int column)
+{
+	GhLogSidecarName(buf, bufsz, fname, histsuffix[column]);
+}
+
+static int GhHistWriteAll(int fd, const void * data, size_t len)
+{
+	const char * p = (const char *)data;
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = write(fd, p, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return 0;
+		}
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/** @brief True if hdr is a column this version can read and append to.
+ */
+static int GhHistUsable(const histheader_s * hdr, int column)
+{
+	return memcmp(hdr->magic, GHHISTMAGIC, sizeof(hdr->magic)) == 0
+		&& hdr->version == GHHISTVERSION && hdr->elemsize == histelemsz[column];
+}
+
+/** @brief Moves every column to <name>.old so new ones can be started.
+ */
+static void GhHistAside(const char * fname)
+{
+	char cname[GHHISTFNAMESZ];
+	char oname[GHHISTFNAMESZ + 4];
+	int i;
+
+	for (i = 0; i < GHHISTCOLS; i++)
+	{
+		GhHistColumnName(cname, sizeof(cname), fname, i);
+		snprintf(oname, sizeof(oname), "%s.old", cname);
+		rename(cname, oname);
+	}
+}
+
+/** @return 1 on success, 0 on an I/O error, -1 if a column is unusable
+ */
+static int GhHistOpenColumns(histwriter_s * hw, const char * fname)
+{
+	char cname[GHHISTFNAMESZ];
+	histheader_s hdr;
+	struct stat st;
+	size_t rows[GHHISTCOLS];
+	size_t minrows = (size_t)-1;
+	int i;
+
+	memset(hw, 0, sizeof(*hw));
+	for (i = 0; i < GHHISTCOLS; i++)
+	{
+		hw->fd[i] = -1;
+	}
+	for (i = 0; i < GHHISTCOLS; i++)
+	{
+		GhHistColumnName(cname, sizeof(cname), fname, i);
+		hw->fd[i] = open(cname, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (hw->fd[i] < 0 || fstat(hw->fd[i], &st) < 0)
+		{
+			GhHistClose(hw);
+			return 0;
+		}
+		if (st.st_size < (off_t)sizeof(hdr))
+		{
+			memset(&hdr, 0, sizeof(hdr));
+			memcpy(hdr.magic, GHHISTMAGIC, sizeof(hdr.magic));
+			hdr.version = GHHISTVERSION;
+			hdr.elemsize = histelemsz[i];
+			hdr.column = i;
+			if (ftruncate(hw->fd[i], 0) < 0 || !GhHistWriteAll(hw->fd[i], &hdr, sizeof(hdr)))
+			{
+				GhHistClose(hw);
+				return 0;
+			}
+			st.st_size = sizeof(hdr);
+		}
+		else if (pread(hw->fd[i], &hdr, sizeof(hdr), 0) != sizeof(hdr) || !GhHistUsable(&hdr, i))
+		{
+			GhHistClose(hw);
+			return -1;
+		}
+		rows[i] = (st.st_size - sizeof(hdr)) / histelemsz[i];
+		if (rows[i] < minrows)
+		{
+			minrows = rows[i];
+		}
+	}
+	// Drop any rows a crash left in some columns but not the others
+	for (i = 0; i < GHHISTCOLS; i++)
+	{
+		if (rows[i] != minrows)
+		{
+			ftruncate(hw->fd[i], sizeof(hdr) + minrows * histelemsz[i]);
+		}
+	}
+	return 1;
+}
+
+/** @brief Opens the columns next to fname for appending.
+ *  @details Columns that can't be used (another format or version) are
+ *           renamed to <name>.old and new ones started, so
+ *           history keeps being written; the CSV log has the old rows.
+ *  @return 1 on success, 0 on failure
+ */
+int GhHistOpen(histwriter_s * hw, const char * fname)
+{
+	int ok;
+
+	ok = GhHistOpenColumns(hw, fname);
+	if (ok < 0)
+	{
+		GhHistAside(fname);
+		ok = GhHistOpenColumns(hw, fname);
+	}
+	return ok > 0;
+}
+
+int GhHistAppend(histwriter_s * hw, reading_s ghdata)
+{
+	if (hw->fd[GHHISTTIME] < 0)
+	{
+		return 0;
+	}
+	if (hw->n == 0)
+	{
+		hw->oldest = ghdata.rtime;
+	}
+	hw->ntime[hw->n] = ghdata.ntime;
+	hw->temperature[hw->n] = ghdata.temperature;
+	hw->humidity[hw->n] = ghdata.humidity;
+	hw->pressure[hw->n] = ghdata.pressure;
+	hw->n++;
+	if (hw->n == GHHISTBATCH || ghdata.rtime - hw->oldest >= GHHISTFLUSHAGE)
+	{
+		return GhHistFlush(hw);
+	}
+	return 1;
+}
+
+int GhHistFlush(histwriter_s * hw)
+{
+	int ok;
+
+	if (hw->n == 0 || hw->fd[GHHISTTIME] < 0)
+	{
+		return 1;
+	}
+	// Time goes last so a reader never sees a timestamp without its values
+	ok = GhHistWriteAll(hw->fd[GHHISTTEMP], hw->temperature, hw->n * sizeof(float))
+		&& GhHistWriteAll(hw->fd[GHHISTHUMID], hw->humidity, hw->n * sizeof(float))
+		&& GhHistWriteAll(hw->fd[GHHISTPRESS], hw->pressure, hw->n * sizeof(float))
+		&& GhHistWriteAll(hw->fd[GHHISTTIME], hw->ntime, hw->n * sizeof(int64_t));
+	hw->n = 0;
+	return ok;
+}
+
+void GhHistClose(histwriter_s * hw)
+{
+	int i;
+
+	if (hw->fd[GHHISTTIME] >= 0)
+	{
+		GhHistFlush(hw);
+	}
+	for (i = 0; i < GHHISTCOLS; i++)
+	{
+		if (hw->fd[i] >= 0)
+		{
+			close(hw->fd[i]);
+		}
+		hw->fd[i] = -1;
+	}
+}
+
+int GhHistMap(histview_s * hv, const char * fname)
+{
+	char cname[GHHISTFNAMESZ];
+	const histheader_s * hdr;
+	struct stat st;
+	size_t rows;
+	int i, fd;
+
+	memset(hv, 0, sizeof(*hv));
+	hv->count = (size_t)-1;
+	for (i = 0; i < GHHISTCOLS; i++)
+	{
+		GhHistColumnName(cname, sizeof(cname), fname, i);
+		fd = open(cname, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			GhHistUnmap(hv);
+			return 0;
+		}
+		if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(histheader_s))
+		{
+			close(fd);
+			GhHistUnmap(hv);
+			return 0;
+		}
+		hv->map[i] = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (hv->map[i] == MAP_FAILED)
+		{
+			hv->map[i] = NULL;
+			GhHistUnmap(hv);
+			return 0;
+		}
+		hv->mapsz[i] = st.st_size;
+		hdr = (const histheader_s *)hv->map[i];
+		if (!GhHistUsable(hdr, i))
+		{
+			GhHistUnmap(hv);
+			return 0;
+		}
+		madvise(hv->map[i], st.st_size, MADV_SEQUENTIAL);
+		rows = (st.st_size - sizeof(histheader_s)) / histelemsz[i];
+		if (rows < hv->count)
+		{
+			hv->count = rows;
+		}
+	}
+	hv->ntime = (const int64_t *)((const char *)hv->map[GHHISTTIME] + sizeof(histheader_s));
+	hv->temperature = (const float *)((const char *)hv->map[GHHISTTEMP] + sizeof(histheader_s));
+	hv->humidity = (const float *)((const char *)hv->map[GHHISTHUMID] + sizeof(histheader_s));
+	hv->pressure = (const float *)((const char *)hv->map[GHHISTPRESS] + sizeof(histheader_s));
+	return 1;
+}
+
+void GhHistUnmap(histview_s * hv)
+{
+	int i;
+
+	for (i = 0; i < GHHISTCOLS; i++)
+	{
+		if (hv->map[i] != NULL)
+		{
+			munmap(hv->map[i], hv->mapsz[i]);
+		}
+	}
+	memset(hv, 0, sizeof(*hv));
+}
+
+/** @brief Index of the first row at or after ntime (binary search).
+ */
+size_t GhHistLowerBound(const histview_s * hv, int64_t ntime)
+{
+	size_t lo = 0, hi = hv->count, mid;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (hv->ntime[mid] < ntime)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/** @brief Rows with from <= ntime < to, as a start index and a count.
+ */
+size_t GhHistRange(const histview_s * hv, int64_t from, int64_t to, size_t * first)
+{
+	size_t lo, hi;
+
+	lo = GhHistLowerBound(hv, from);
+	hi = GhHistLowerBound(hv, to);
+	*first = lo;
+	return hi > lo ? hi - lo : 0;
+}
+
+/** @brief Walks the readings with from <= ntime < to.
+ *  @details The mapped columns are the fast path: the range is found by
+ *           binary search and read as plain arrays. The compressed blocks
+ *           supply whatever is older than the first column row, or the
+ *           whole range when there are no columns. The ring follows for
+ *           readings not flushed to either yet. Any source may be missing
+ *           (fname or ring NULL).
+ */
+void GhHistCursorOpen(histcursor_s * hc, const char * fname, const ring_s * ring, int64_t from, int64_t to)
+{
+	int64_t flushed = INT64_MIN;
+	size_t first;
+
+	memset(hc, 0, sizeof(*hc));
+	hc->ring = ring;
+	hc->to = to;
+	hc->bto = to;
+	if (fname != NULL && GhHistMap(&hc->hv, fname) && hc->hv.count > 0)
+	{
+		hc->hend = GhHistRange(&hc->hv, from, to, &first);
+		hc->hnext = first;
+		hc->hend += first;
+		// Blocks keep whole ticks: the first row's tick is the columns' own
+		if (hc->hv.ntime[0] - hc->hv.ntime[0] % GHBLOCKTICK < hc->bto)
+		{
+			hc->bto = hc->hv.ntime[0] - hc->hv.ntime[0] % GHBLOCKTICK;
+		}
+		flushed = hc->hv.ntime[hc->hv.count - 1] + 1;
+	}
+	if (fname != NULL && GhBlockScanOpen(&hc->bs, fname))
+	{
+		hc->blocks = from < hc->bto && GhBlockScanSeek(&hc->bs, from);
+		if (GhBlockScanEnd(&hc->bs) > flushed)
+		{
+			flushed = GhBlockScanEnd(&hc->bs);
+		}
+	}
+	// The ring picks up after the last flushed reading
+	if (flushed > from)
+	{
+		from = flushed;
+	}
+	if (ring != NULL && from < to)
+	{
+		hc->rnext = GhRingLowerBound(ring, from);
+		hc->rend = GhRingHead(ring);
+	}
+}
+
+/** @return 1 with the next reading in rd, 0 at the end of the range
+ */
+int GhHistCursorNext(histcursor_s * hc, reading_s * rd)
+{
+	if (hc->blocks)
+	{
+		if (GhBlockScanNext(&hc->bs, rd) && rd->ntime < hc->bto)
+		{
+			return 1;
+		}
+		hc->blocks = 0;
+	}
+	if (hc->hnext < hc->hend)
+	{
+		memset(rd, 0, sizeof(*rd));
+		rd->ntime = hc->hv.ntime[hc->hnext];
+		rd->rtime = (time_t)(rd->ntime / GHNSPERSEC);
+		rd->temperature = hc->hv.temperature[hc->hnext];
+		rd->humidity = hc->hv.humidity[hc->hnext];
+		rd->pressure = hc->hv.pressure[hc->hnext];
+		hc->hnext++;
+		return 1;
+	}
+	while (hc->rnext < hc->rend)
+	{
+		if (GhRingGet(hc->ring, hc->rnext++, rd))
+		{
+			if (rd->ntime >= hc->to)
+			{
+				hc->rnext = hc->rend;
+				return 0;
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void GhHistCursorClose(histcursor_s * hc)
+{
+	GhHistUnmap(&hc->hv);
+	GhBlockScanClose(&hc->bs);
+	memset(hc, 0, sizeof(*hc));
+}
@@ -0,0 +1,94 @@
+/** @brief Gh columnar history constants, structures, function prototypes
+ *  @file ghhist.h
+ */
+
+#ifndef GHHIST_H
+#define GHHIST_H
+
+// Includes
+//
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "ghcontrol.h"
+#include "ghring.h"
+#include "ghblock.h"
+
+// Constants
+
+#define GHHISTMAGIC "GHCL"
+#define GHHISTVERSION 1
+#define GHHISTCOLS 4
+#define GHHISTTIME 0
+#define GHHISTTEMP 1
+#define GHHISTHUMID 2
+#define GHHISTPRESS 3
+#define GHHISTBATCH 64
+#define GHHISTFLUSHAGE 60
+#define GHHISTFNAMESZ 256
+
+// Structures
+
+typedef struct histheader
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t elemsize;
+	uint32_t column;
+	uint32_t reserved;
+}histheader_s;
+
+typedef struct histwriter
+{
+	int fd[GHHISTCOLS];
+	int n;
+	time_t oldest;
+	int64_t ntime[GHHISTBATCH];
+	float temperature[GHHISTBATCH];
+	float humidity[GHHISTBATCH];
+	float pressure[GHHISTBATCH];
+}histwriter_s;
+
+typedef struct histview
+{
+	void * map[GHHISTCOLS];
+	size_t mapsz[GHHISTCOLS];
+	size_t count;
+	const int64_t * ntime;
+	const float * temperature;
+	const float * humidity;
+	const float * pressure;
+}histview_s;
+
+typedef struct histcursor
+{
+	histview_s hv;
+	blockscan_s bs;
+	int blocks;
+	int64_t bto;
+	const ring_s * ring;
+	size_t hnext;
+	size_t hend;
+	uint64_t rnext;
+	uint64_t rend;
+	int64_t to;
+}histcursor_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+void GhHistColumnName(char * buf, size_t bufsz, const char * fname, int column);
+int GhHistOpen(histwriter_s * hw, const char * fname);
+int GhHistAppend(histwriter_s * hw, reading_s ghdata);
+int GhHistFlush(histwriter_s * hw);
+void GhHistClose(histwriter_s * hw);
+int GhHistMap(histview_s * hv, const char * fname);
+void GhHistUnmap(histview_s * hv);
+size_t GhHistLowerBound(const histview_s * hv, int64_t ntime);
+size_t GhHistRange(const histview_s * hv, int64_t from, int64_t to, size_t * first);
+void GhHistCursorOpen(histcursor_s * hc, const char * fname, const ring_s * ring, int64_t from, int64_t to);
+int GhHistCursorNext(histcursor_s * hc, reading_s * rd);
+void GhHistCursorClose(histcursor_s * hc);
+
+///@endcond
+#endif
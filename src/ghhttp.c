@@ -0,0 +1,603 @@
+/** @brief Gh HTTP/JSON server
+ *  @file ghhttp.c
+ *  @details A small HTTP/1.1 server served from the scheduler loop, for
+ *           browsers and scripts:
+ *
+ *               GET /readings                  the latest reading
+ *               GET /controls                  heater, humidifier and setpoints
+ *               GET /history?from=&to=[&max=]  readings with from <= time < to
+ *               GET /events                    Server-Sent Events, one per reading
+ *
+ *           Times are milliseconds since the epoch, as JavaScript uses; a
+ *           malformed or reversed range is a 400. The server listens on
+ *           loopback unless built with another GHHTTPADDR.
+ *           Every connection owns fixed header and body buffers that are
+ *           reused for each response and sent together with sendmsg().
+ *           History is sent in chunks of one body buffer as the client
+ *           drains them. An SSE event is formatted once and written to
+ *           every subscriber; one that can't keep up is dropped and its
+ *           EventSource reconnects. Keep-alive and pipelined requests are
+ *           answered in order.
+ */
+#include "ghhttp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define NSPERMSEC 1000000LL
+
+static const char ghhttptail[] = "\r\n0\r\n\r\n";
+static const char ghhttpcrlf[] = "\r\n";
+
+static void GhHttpDrop(httpconn_s * c)
+{
+	if (c->state == GHHTTPEVENTS)
+	{
+		c->srv->subscribers--;
+	}
+	GhSchedDelFd(c->srv->sch, c->fd);
+	close(c->fd);
+	GhHistCursorClose(&c->hc);
+	c->fd = -1;
+	c->srv->nconns--;
+}
+
+static void GhHttpBody(httpconn_s * c, const char * fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void GhHttpBody(httpconn_s * c, const char * fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(c->body + c->bodylen, sizeof(c->body) - c->bodylen, fmt, ap);
+	va_end(ap);
+	if (n > 0)
+	{
+		c->bodylen += (size_t)n < sizeof(c->body) - c->bodylen ? (size_t)n : sizeof(c->body) - c->bodylen - 1;
+	}
+}
+
+/** @brief JSON has no NaN, so a missing value is null.
+ */
+static const char * GhHttpFloat(char * buf, size_t bufsz, float v)
+{
+	if (!isfinite(v))
+	{
+		return "null";
+	}
+	snprintf(buf, bufsz, "%.2f", v);
+	return buf;
+}
+
+static int GhHttpReading(char * buf, size_t bufsz, const reading_s * rd)
+{
+	char t[16], h[16], p[16];
+
+	return snprintf(buf, bufsz, "{\"time\":%lld,\"temperature\":%s,\"humidity\":%s,\"pressure\":%s,\"stale\":%d}",
+			(long long)(rd->ntime / NSPERMSEC), GhHttpFloat(t, sizeof(t), rd->temperature),
+			GhHttpFloat(h, sizeof(h), rd->humidity), GhHttpFloat(p, sizeof(p), rd->pressure), rd->stale);
+}
+
+static void GhHttpIov(httpconn_s * c, const void * base, size_t len)
+{
+	if (len > 0)
+	{
+		c->iov[c->iovcnt].iov_base = (void *)base;
+		c->iov[c->iovcnt].iov_len = len;
+		c->iovcnt++;
+	}
+}
+
+/** @brief Queues the status line and headers, and the body unless chunked.
+ */
+static void GhHttpRespond(httpconn_s * c, int status, const char * reason, const char * type)
+{
+	int n;
+
+	n = snprintf(c->hdr, sizeof(c->hdr), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n"
+			GHHTTPCORS "Cache-Control: no-cache\r\n", status, reason, type);
+	if (c->state == GHHTTPEVENTS)
+	{
+		n += snprintf(c->hdr + n, sizeof(c->hdr) - n, "Connection: keep-alive\r\n\r\n");
+	}
+	else if (c->chunked)
+	{
+		n += snprintf(c->hdr + n, sizeof(c->hdr) - n, "Transfer-Encoding: chunked\r\n%s\r\n",
+				c->keepalive ? "" : "Connection: close\r\n");
+	}
+	else
+	{
+		n += snprintf(c->hdr + n, sizeof(c->hdr) - n, "Content-Length: %zu\r\n%s\r\n", c->bodylen,
+				c->keepalive ? "" : "Connection: close\r\n");
+	}
+	c->iovcnt = 0;
+	GhHttpIov(c, c->hdr, n);
+	if (!c->chunked)
+	{
+		GhHttpIov(c, c->body, c->bodylen);
+	}
+}
+
+/** @brief Appends history rows to the body and queues it as one chunk.
+ *  @details The last chunk carries the closing bracket and the zero-length
+ *           chunk that ends the response.
+ */
+static void GhHttpFill(httpconn_s * c)
+{
+	char row[GHHTTPROWSZ];
+	reading_s rd;
+	int more = 1;
+
+	while (c->bodylen + GHHTTPROWSZ < sizeof(c->body) && c->rows < c->maxrows
+			&& (more = GhHistCursorNext(&c->hc, &rd)))
+	{
+		GhHttpReading(row, sizeof(row), &rd);
+		GhHttpBody(c, "%s%s", c->rows > 0 ? "," : "", row);
+		c->rows++;
+	}
+	if (!more || c->rows == c->maxrows)
+	{
+		GhHttpBody(c, "]");
+		GhHistCursorClose(&c->hc);
+		c->chunked = 0;
+	}
+	snprintf(c->chunk, sizeof(c->chunk), "%zx\r\n", c->bodylen);
+	GhHttpIov(c, c->chunk, strlen(c->chunk));
+	GhHttpIov(c, c->body, c->bodylen);
+	if (c->chunked)
+	{
+		GhHttpIov(c, ghhttpcrlf, 2);
+	}
+	else
+	{
+		GhHttpIov(c, ghhttptail, sizeof(ghhttptail) - 1);
+	}
+}
+
+/** @brief Finds name=value in query; value must be an integer ending at & or the end.
+ *  @return 1 if found, 0 if absent, -1 if it is not a number
+ */
+static int GhHttpParam(const char * query, const char * name, long long * value)
+{
+	size_t len = strlen(name);
+	const char * p = query;
+	char * end;
+
+	while (p != NULL && *p != 0)
+	{
+		if (strncmp(p, name, len) == 0 && p[len] == '=')
+		{
+			errno = 0;
+			*value = strtoll(p + len + 1, &end, 10);
+			if (end == p + len + 1 || (*end != 0 && *end != '&') || errno != 0)
+			{
+				return -1;
+			}
+			return 1;
+		}
+		p = strchr(p, '&');
+		if (p != NULL)
+		{
+			p++;
+		}
+	}
+	return 0;
+}
+
+/** @brief Scales ms to ns, clamped so the product can't overflow.
+ */
+static int64_t GhHttpMsToNs(long long ms)
+{
+	if (ms < INT64_MIN / NSPERMSEC)
+	{
+		ms = INT64_MIN / NSPERMSEC;
+	}
+	else if (ms > INT64_MAX / NSPERMSEC)
+	{
+		ms = INT64_MAX / NSPERMSEC;
+	}
+	return (int64_t)ms * NSPERMSEC;
+}
+
+static void GhHttpError(httpconn_s * c, int status, const char * reason)
+{
+	c->bodylen = 0;
+	GhHttpBody(c, "{\"error\":\"%s\"}", reason);
+	GhHttpRespond(c, status, reason, "application/json");
+}
+
+/** @brief Routes one request whose header ends at hend.
+ */
+static void GhHttpHandle(httpconn_s * c, char * hend)
+{
+	httpserver_s * srv = c->srv;
+	char method[8], target[256], version[16];
+	char t[16], h[16];
+	long long from, to, max;
+	char * query;
+
+	*hend = 0;
+	srv->requests++;
+	c->state = GHHTTPRESPONSE;
+	c->chunked = 0;
+	c->bodylen = 0;
+	if (sscanf(c->in, "%7s %255s %15s", method, target, version) != 3)
+	{
+		c->keepalive = 0;
+		GhHttpError(c, 400, "Bad Request");
+		return;
+	}
+	c->keepalive = strcmp(version, "HTTP/1.1") == 0 && strcasestr(c->in, "\nConnection: close") == NULL;
+	if (strcmp(method, "GET") != 0)
+	{
+		c->keepalive = 0;
+		GhHttpError(c, 405, "Method Not Allowed");
+		return;
+	}
+	query = strchr(target, '?');
+	if (query != NULL)
+	{
+		*query++ = 0;
+	}
+	if (strcmp(target, "/readings") == 0)
+	{
+		c->bodylen = GhHttpReading(c->body, sizeof(c->body), srv->rd);
+		GhHttpRespond(c, 200, "OK", "application/json");
+	}
+	else if (strcmp(target, "/controls") == 0)
+	{
+		GhHttpBody(c, "{\"heater\":%d,\"humidifier\":%d,\"setpoints\":{\"temperature\":%s,\"humidity\":%s}}",
+				srv->ctrl->heater, srv->ctrl->humidifier, GhHttpFloat(t, sizeof(t), srv->sets->temperature),
+				GhHttpFloat(h, sizeof(h), srv->sets->humidity));
+		GhHttpRespond(c, 200, "OK", "application/json");
+	}
+	else if (strcmp(target, "/history") == 0)
+	{
+		from = 0;
+		to = INT64_MAX / NSPERMSEC;
+		max = GHHTTPMAXROWS;
+		if (GhHttpParam(query, "from", &from) < 0 || GhHttpParam(query, "to", &to) < 0
+				|| GhHttpParam(query, "max", &max) < 0 || from > to)
+		{
+			GhHttpError(c, 400, "Bad Request");
+			return;
+		}
+		if (max <= 0 || max > GHHTTPMAXROWS)
+		{
+			max = GHHTTPMAXROWS;
+		}
+		GhHistCursorOpen(&c->hc, srv->logname, srv->ring, GhHttpMsToNs(from), GhHttpMsToNs(to));
+		c->rows = 0;
+		c->maxrows = max;
+		c->chunked = 1;
+		GhHttpRespond(c, 200, "OK", "application/json");
+		GhHttpBody(c, "[");
+		GhHttpFill(c);
+	}
+	else if (strcmp(target, "/events") == 0)
+	{
+		c->state = GHHTTPEVENTS;
+		srv->subscribers++;
+		GhHttpBody(c, "retry: %d\n\ndata: ", GHHTTPRETRY);
+		c->bodylen += GhHttpReading(c->body + c->bodylen, sizeof(c->body) - c->bodylen, srv->rd);
+		GhHttpBody(c, "\n\n");
+		GhHttpRespond(c, 200, "OK", "text/event-stream");
+	}
+	else
+	{
+		GhHttpError(c, 404, "Not Found");
+	}
+}
+
+/** @brief Sends queued buffers; returns 1 when all went, 0 on EAGAIN, -1 on error.
+ */
+static int GhHttpWrite(httpconn_s * c, size_t * sent)
+{
+	struct msghdr msg;
+	ssize_t n;
+
+	while (c->iovcnt > 0)
+	{
+		// sendmsg() rather than writev() for MSG_NOSIGNAL
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = c->iov;
+		msg.msg_iovlen = c->iovcnt;
+		n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		*sent += n;
+		while (c->iovcnt > 0 && (size_t)n >= c->iov[0].iov_len)
+		{
+			n -= c->iov[0].iov_len;
+			memmove(&c->iov[0], &c->iov[1], (c->iovcnt - 1) * sizeof(c->iov[0]));
+			c->iovcnt--;
+		}
+		if (c->iovcnt > 0)
+		{
+			c->iov[0].iov_base = (char *)c->iov[0].iov_base + n;
+			c->iov[0].iov_len -= n;
+		}
+	}
+	return 1;
+}
+
+/** @brief Sends what is queued, then starts on the next request.
+ *  @details Each wakeup sends about one body buffer, so a long history
+ *           never holds up the scheduler's tasks.
+ */
+static void GhHttpService(httpconn_s * c)
+{
+	size_t sent = 0;
+	uint32_t events;
+	char * hend;
+	int rv;
+
+	while (1)
+	{
+		if (c->iovcnt > 0)
+		{
+			rv = GhHttpWrite(c, &sent);
+			if (rv < 0)
+			{
+				GhHttpDrop(c);
+				return;
+			}
+			if (rv == 0)
+			{
+				break;
+			}
+			continue;
+		}
+		if (c->state == GHHTTPEVENTS)
+		{
+			break;
+		}
+		if (c->state == GHHTTPRESPONSE)
+		{
+			if (c->chunked)
+			{
+				if (sent >= GHHTTPBODYSZ)
+				{
+					break;
+				}
+				c->bodylen = 0;
+				GhHttpFill(c);
+				continue;
+			}
+			if (!c->keepalive)
+			{
+				GhHttpDrop(c);
+				return;
+			}
+			c->state = GHHTTPREQUEST;
+		}
+		hend = (char *)memmem(c->in, c->inlen, "\r\n\r\n", 4);
+		if (hend == NULL)
+		{
+			if (c->inlen == sizeof(c->in))
+			{
+				c->state = GHHTTPRESPONSE;
+				c->keepalive = 0;
+				c->chunked = 0;
+				c->inlen = 0;
+				GhHttpError(c, 431, "Request Header Fields Too Large");
+				continue;
+			}
+			break;
+		}
+		GhHttpHandle(c, hend);
+		c->inlen -= hend + 4 - c->in;
+		memmove(c->in, hend + 4, c->inlen);
+	}
+	events = 0;
+	if (c->inlen < sizeof(c->in))
+	{
+		events |= EPOLLIN;
+	}
+	if (c->iovcnt > 0 || c->chunked)
+	{
+		events |= EPOLLOUT;
+	}
+	GhSchedModFd(c->srv->sch, c->fd, events);
+}
+
+static void GhHttpConn(int fd, uint32_t events, void * arg)
+{
+	httpconn_s * c = (httpconn_s *)arg;
+	char discard[256];
+	ssize_t n;
+
+	if (events & EPOLLIN)
+	{
+		// A subscriber has nothing more to say; only its hangup matters
+		if (c->state == GHHTTPEVENTS)
+		{
+			n = recv(fd, discard, sizeof(discard), 0);
+		}
+		else
+		{
+			n = recv(fd, c->in + c->inlen, sizeof(c->in) - c->inlen, 0);
+		}
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		{
+			GhHttpDrop(c);
+			return;
+		}
+		if (n > 0 && c->state != GHHTTPEVENTS)
+		{
+			c->inlen += n;
+		}
+	}
+	else if (events & (EPOLLHUP | EPOLLERR))
+	{
+		GhHttpDrop(c);
+		return;
+	}
+	GhHttpService(c);
+}
+
+static void GhHttpAccept(int fd, uint32_t events, void * arg)
+{
+	httpserver_s * srv = (httpserver_s *)arg;
+	httpconn_s * c;
+	int cfd, i;
+
+	while ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		c = NULL;
+		for (i = 0; i < GHHTTPMAXCONN; i++)
+		{
+			if (srv->conn[i].fd < 0)
+			{
+				c = &srv->conn[i];
+				break;
+			}
+		}
+		if (c == NULL || !GhSchedAddFd(srv->sch, cfd, EPOLLIN, GhHttpConn, c))
+		{
+			srv->rejected++;
+			close(cfd);
+			continue;
+		}
+		memset(c, 0, sizeof(*c));
+		c->fd = cfd;
+		c->srv = srv;
+		srv->nconns++;
+	}
+}
+
+/** @brief Sends a reading to every /events subscriber.
+ */
+void GhHttpPublish(httpserver_s * srv, reading_s rd)
+{
+	char event[GHHTTPEVENTSZ];
+	httpconn_s * c;
+	size_t len, pending;
+	ssize_t n;
+	int i;
+
+	if (srv->fd < 0 || srv->subscribers == 0)
+	{
+		return;
+	}
+	len = snprintf(event, sizeof(event), "data: ");
+	len += GhHttpReading(event + len, sizeof(event) - len, &rd);
+	len += snprintf(event + len, sizeof(event) - len, "\n\n");
+	for (i = 0; i < GHHTTPMAXCONN; i++)
+	{
+		c = &srv->conn[i];
+		if (c->fd < 0 || c->state != GHHTTPEVENTS)
+		{
+			continue;
+		}
+		if (c->iovcnt == 0)
+		{
+			n = send(c->fd, event, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (n == (ssize_t)len)
+			{
+				continue;
+			}
+			if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				GhHttpDrop(c);
+				continue;
+			}
+			n = n < 0 ? 0 : n;
+			memcpy(c->body, event + n, len - n);
+			c->bodylen = len - n;
+			GhHttpIov(c, c->body, c->bodylen);
+			GhSchedModFd(srv->sch, c->fd, EPOLLIN | EPOLLOUT);
+			continue;
+		}
+		// Still sending an earlier event: queue behind it if there is room
+		pending = c->iov[0].iov_len;
+		if (c->iovcnt != 1 || c->iov[0].iov_base < (void *)c->body
+				|| pending + len > sizeof(c->body))
+		{
+			srv->lagged++;
+			GhHttpDrop(c);
+			continue;
+		}
+		memmove(c->body, c->iov[0].iov_base, pending);
+		memcpy(c->body + pending, event, len);
+		c->iov[0].iov_base = c->body;
+		c->iov[0].iov_len = pending + len;
+	}
+}
+
+/** @brief Listens on addr:port and serves connections from the scheduler loop.
+ *  @details The caller fills in rd, ctrl, sets, ring and logname before
+ *           running the scheduler.
+ *  @return 1 on success, 0 if the socket can't be set up
+ */
+int GhHttpOpen(httpserver_s * srv, sched_s * sch, const char * addr, int port)
+{
+	struct sockaddr_in sin;
+	int i, on = 1;
+
+	memset(srv, 0, sizeof(*srv));
+	srv->fd = -1;
+	for (i = 0; i < GHHTTPMAXCONN; i++)
+	{
+		srv->conn[i].fd = -1;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1)
+	{
+		return 0;
+	}
+	srv->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (srv->fd < 0)
+	{
+		return 0;
+	}
+	setsockopt(srv->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(srv->fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+			|| listen(srv->fd, GHHTTPBACKLOG) < 0
+			|| !GhSchedAddFd(sch, srv->fd, EPOLLIN, GhHttpAccept, srv))
+	{
+		close(srv->fd);
+		srv->fd = -1;
+		return 0;
+	}
+	srv->sch = sch;
+	return 1;
+}
+
+void GhHttpClose(httpserver_s * srv)
+{
+	int i;
+
+	if (srv->fd < 0)
+	{
+		return;
+	}
+	for (i = 0; i < GHHTTPMAXCONN; i++)
+	{
+		if (srv->conn[i].fd >= 0)
+		{
+			GhHttpDrop(&srv->conn[i]);
+		}
+	}
+	GhSchedDelFd(srv->sch, srv->fd);
+	close(srv->fd);
+	srv->fd = -1;
+}
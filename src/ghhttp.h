@@ -0,0 +1,98 @@
+/** @brief Gh HTTP/JSON server constants, structures, function prototypes
+ *  @file ghhttp.h
+ */
+
+#ifndef GHHTTP_H
+#define GHHTTP_H
+
+// Includes
+//
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "ghcontrol.h"
+#include "ghhist.h"
+#include "ghring.h"
+#include "ghsched.h"
+
+// Constants
+
+// Loopback only; build with -DGHHTTPADDR='"0.0.0.0"' to serve the network
+#ifndef GHHTTPADDR
+#define GHHTTPADDR "127.0.0.1"
+#endif
+#ifndef GHHTTPPORT
+#define GHHTTPPORT 8080
+#endif
+// Same-origin only; build with -DGHHTTPORIGIN='"http://host"' to let a page
+// elsewhere read the data
+#ifdef GHHTTPORIGIN
+#define GHHTTPCORS "Access-Control-Allow-Origin: " GHHTTPORIGIN "\r\n"
+#else
+#define GHHTTPCORS ""
+#endif
+#define GHHTTPMAXCONN 48
+#define GHHTTPBACKLOG 16
+#define GHHTTPINSZ 2048
+#define GHHTTPHDRSZ 256
+#define GHHTTPBODYSZ 4096
+#define GHHTTPEVENTSZ 256
+#define GHHTTPROWSZ 128
+#define GHHTTPMAXROWS 100000
+#define GHHTTPRETRY 2000
+
+// Connection states
+#define GHHTTPREQUEST 0
+#define GHHTTPRESPONSE 1
+#define GHHTTPEVENTS 2
+
+// Structures
+
+struct httpserver;
+
+typedef struct httpconn
+{
+	int fd;
+	struct httpserver * srv;
+	int state;
+	int keepalive;
+	int chunked;
+	size_t inlen;
+	char in[GHHTTPINSZ];
+	struct iovec iov[4];
+	int iovcnt;
+	char hdr[GHHTTPHDRSZ];
+	char chunk[16];
+	size_t bodylen;
+	char body[GHHTTPBODYSZ];
+	histcursor_s hc;
+	size_t rows;
+	size_t maxrows;
+}httpconn_s;
+
+typedef struct httpserver
+{
+	int fd;
+	sched_s * sch;
+	const char * logname;
+	const reading_s * rd;
+	const control_s * ctrl;
+	const setpoint_s * sets;
+	const ring_s * ring;
+	int nconns;
+	int subscribers;
+	unsigned long requests;
+	unsigned long rejected;
+	unsigned long lagged;
+	httpconn_s conn[GHHTTPMAXCONN];
+}httpserver_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+int GhHttpOpen(httpserver_s * srv, sched_s * sch, const char * addr, int port);
+void GhHttpPublish(httpserver_s * srv, reading_s rd);
+void GhHttpClose(httpserver_s * srv);
+
+///@endcond
+#endif
@@ -0,0 +1,375 @@
+/** @brief ghload: synthetic stations and throughput benchmark for ghcollect
+ *  @file ghload.c
+ *  @details ghload [-n stations] [-z zones] [-r hz] [-d seconds] [-b]
+ *                  [-t] [-c conns] [-a addr] [-p feedport] [-q queryport]
+ *                  [-g group] [-i ifaddr]
+ *
+ *           Plays n stations, each sending -r readings a second, spread
+ *           evenly over every millisecond. Records go to the multicast group
+ *           (one socket, sendmmsg() batches) or, with -t, over c TCP feeds
+ *           to the collector at addr. With -b every station sends as fast
+ *           as the transport takes it. Station i has serial GHLOADSERIAL + i,
+ *           sits in zone i % zones, and reports slow sine waves around
+ *           typical greenhouse values.
+ *
+ *           Before and after the run ghload asks the collector for its
+ *           totals and prints what was sent against what was collected.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "ghmcast.h"
+
+#define GHLOADSERIAL 0x4C4F414400000000ull
+#define GHLOADSTATIONS 10000
+#define GHLOADZONES 8
+#define GHLOADRATE 1
+#define GHLOADSECS 10
+#define GHLOADCONNS 4
+#define GHLOADMAXCONNS 64
+#define GHLOADADDR "127.0.0.1"
+#define GHLOADPORT 4300
+#define GHLOADQUERYPORT 4301
+#define GHLOADSETTLE 1500
+#define GHLOADLINESZ 512
+
+typedef struct loadtotals
+{
+	unsigned long long stations;
+	unsigned long long records;
+	unsigned long long processed;
+	unsigned long long dropped;
+	unsigned long long lost;
+	unsigned long long full;
+}loadtotals_s;
+
+static int64_t GhLoadNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * GHNSPERSEC + ts.tv_nsec;
+}
+
+static int64_t GhLoadRealNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * GHNSPERSEC + ts.tv_nsec;
+}
+
+static void GhLoadSleep(int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+	{
+	}
+}
+
+static int GhLoadConnect(const char * addr, int port)
+{
+	struct sockaddr_in sin;
+	int fd, on = 1;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1)
+	{
+		return -1;
+	}
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/** @brief Asks the collector at addr for its totals.
+ *  @return 1 on success, 0 if it can't be reached or the reply is garbled
+ */
+static int GhLoadTotals(const char * addr, int port, loadtotals_s * lt)
+{
+	struct timeval tv = { 2, 0 };
+	char line[GHLOADLINESZ];
+	size_t len = 0;
+	ssize_t n;
+	int fd, ok;
+
+	fd = GhLoadConnect(addr, port);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	ok = send(fd, "stats\n", 6, MSG_NOSIGNAL) == 6;
+	while (ok && len < sizeof(line) - 1 && memchr(line, '\n', len) == NULL)
+	{
+		n = recv(fd, line + len, sizeof(line) - 1 - len, 0);
+		ok = n > 0;
+		len += ok ? n : 0;
+	}
+	close(fd);
+	line[len] = '\0';
+	return ok && sscanf(line, "ok stations=%llu records=%llu processed=%llu dropped=%llu lost=%llu full=%llu",
+			&lt->stations, &lt->records, &lt->processed, &lt->dropped, &lt->lost, &lt->full) == 6;
+}
+
+static void GhLoadRecord(mcastrecord_s * rec, int station, int zones, uint32_t seq, int64_t ntime)
+{
+	double phase, t;
+
+	// Each station drifts through a ten minute cycle from its own phase
+	phase = station * 0.618033988749895 * 2 * M_PI;
+	t = ntime / 1e9 * 2 * M_PI / 600 + phase;
+	rec->station = GHLOADSERIAL + station;
+	rec->zone = station % zones;
+	rec->seq = seq;
+	rec->ntime = ntime;
+	rec->temperature = 22.0 + rec->zone * 0.5 + 3.0 * sin(t);
+	rec->humidity = 55.0 + 10.0 * sin(t + 1.0);
+	rec->pressure = 1013.0 + 2.0 * sin(t / 7);
+	rec->stale = 0;
+	rec->controls = (rec->temperature < 22.0 ? GHMCASTHEATER : 0) | (rec->humidity < 50.0 ? GHMCASTHUMIDIFIER : 0);
+}
+
+/** @brief Writes a whole batch to a TCP feed, or sends it as datagrams.
+ *  @return the number of records that went out
+ */
+static int GhLoadSend(int fd, int tcp, uint8_t (*buf)[GHMCASTRECSZ], struct mmsghdr * msg, int count)
+{
+	struct pollfd pfd;
+	size_t done = 0, len;
+	ssize_t n;
+	int sent = 0;
+
+	if (tcp)
+	{
+		len = (size_t)count * GHMCASTRECSZ;
+		while (done < len)
+		{
+			n = send(fd, (uint8_t *)buf + done, len - done, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (n <= 0)
+			{
+				return done / GHMCASTRECSZ;
+			}
+			done += n;
+		}
+		return count;
+	}
+	while (sent < count)
+	{
+		n = sendmmsg(fd, msg + sent, count - sent, 0);
+		if (n < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS && errno != EINTR)
+			{
+				break;
+			}
+			// The socket buffer is full: wait for room rather than drop here
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			poll(&pfd, 1, 10);
+			continue;
+		}
+		sent += n;
+	}
+	return sent;
+}
+
+int main(int argc, char * argv[])
+{
+	static uint8_t buf[GHMCASTBATCH][GHMCASTRECSZ];
+	static struct mmsghdr msg[GHMCASTBATCH];
+	static struct iovec iov[GHMCASTBATCH];
+	static int fds[GHLOADMAXCONNS];
+	const char * addr = GHLOADADDR;
+	const char * group = GHMCASTGROUP;
+	const char * ifaddr = NULL;
+	int stations = GHLOADSTATIONS, zones = GHLOADZONES, conns = GHLOADCONNS;
+	int rate = GHLOADRATE, secs = GHLOADSECS, flood = 0, tcp = 0;
+	int port = GHLOADPORT, qport = GHLOADQUERYPORT;
+	mcastsender_s ms;
+	mcastrecord_s rec;
+	loadtotals_s before, after;
+	uint32_t * seq;
+	uint64_t sent = 0, due, failed = 0, collected;
+	int64_t start, end, now, ntime;
+	int i, k, opt, count, station, conn, have;
+	double elapsed;
+
+	while ((opt = getopt(argc, argv, "n:z:r:d:btc:a:p:q:g:i:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			stations = atoi(optarg);
+			break;
+		case 'z':
+			zones = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'd':
+			secs = atoi(optarg);
+			break;
+		case 'b':
+			flood = 1;
+			break;
+		case 't':
+			tcp = 1;
+			break;
+		case 'c':
+			conns = atoi(optarg);
+			break;
+		case 'a':
+			addr = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'q':
+			qport = atoi(optarg);
+			break;
+		case 'g':
+			group = optarg;
+			break;
+		case 'i':
+			ifaddr = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n stations] [-z zones] [-r hz] [-d seconds] [-b]"
+					" [-t] [-c conns] [-a addr] [-p feedport] [-q queryport] [-g group] [-i ifaddr]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (stations < 1 || zones < 1 || zones > GHMCASTZONES || rate < 1 || secs < 1
+			|| conns < 1 || conns > GHLOADMAXCONNS)
+	{
+		fprintf(stderr, "%s: bad argument\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	seq = (uint32_t *)calloc(stations, sizeof(uint32_t));
+	if (seq == NULL)
+	{
+		return EXIT_FAILURE;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	ms.fd = -1;
+	if (tcp)
+	{
+		for (i = 0; i < conns; i++)
+		{
+			fds[i] = GhLoadConnect(addr, port);
+			if (fds[i] < 0)
+			{
+				fprintf(stderr, "Can't connect to %s:%d\n", addr, port);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	else
+	{
+		if (!GhMcastOpen(&ms, group, GHMCASTPORT, ifaddr, 0, 0))
+		{
+			fprintf(stderr, "Can't send to multicast group %s:%d\n", group, GHMCASTPORT);
+			return EXIT_FAILURE;
+		}
+		conns = 1;
+		fds[0] = ms.fd;
+	}
+	for (i = 0; i < GHMCASTBATCH; i++)
+	{
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = GHMCASTRECSZ;
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	have = GhLoadTotals(addr, qport, &before);
+	start = GhLoadNow();
+	end = start + (int64_t)secs * GHNSPERSEC;
+	conn = 0;
+	for (now = start; now < end; now = GhLoadNow())
+	{
+		// Records owed by now at stations * rate a second
+		due = flood ? sent + GHMCASTBATCH : (uint64_t)((now - start) / 1e9 * stations * rate);
+		if (due <= sent)
+		{
+			GhLoadSleep(1);
+			continue;
+		}
+		ntime = GhLoadRealNow();
+		while (sent < due)
+		{
+			count = due - sent < GHMCASTBATCH ? due - sent : GHMCASTBATCH;
+			for (k = 0; k < count; k++)
+			{
+				station = (sent + k) % stations;
+				GhLoadRecord(&rec, station, zones, seq[station]++, ntime);
+				GhMcastEncode(buf[k], &rec);
+			}
+			k = GhLoadSend(fds[conn], tcp, buf, msg, count);
+			failed += count - k;
+			sent += count;
+			conn = (conn + 1) % conns;
+			if (k < count && tcp)
+			{
+				fprintf(stderr, "Feed closed by %s\n", addr);
+				end = now;
+				break;
+			}
+		}
+	}
+	elapsed = (GhLoadNow() - start) / 1e9;
+	for (i = 0; tcp && i < conns; i++)
+	{
+		close(fds[i]);
+	}
+	GhMcastClose(&ms);
+	fprintf(stdout, "Sent\t\t%llu records from %d stations in %.2fs: %.0f/s (%llu failed)\n",
+			(unsigned long long)sent, stations, elapsed, sent / elapsed, (unsigned long long)failed);
+	// Let the collector drain its queues before counting
+	GhLoadSleep(GHLOADSETTLE);
+	if (have && GhLoadTotals(addr, qport, &after))
+	{
+		// A record the store had no room for was processed but not kept
+		collected = (after.processed - before.processed) - (after.full - before.full);
+		fprintf(stdout, "Collected\t%llu records: %.0f/s, %.2f%% of sent\n",
+				(unsigned long long)collected, collected / elapsed,
+				sent > 0 ? 100.0 * collected / sent : 0.0);
+		fprintf(stdout, "Collector\tStations: %llu\tReceived: %llu\tQueue drops: %llu\tSequence gaps: %llu\tNo room: %llu\n",
+				after.stations, after.records - before.records, after.dropped - before.dropped,
+				after.lost - before.lost, after.full - before.full);
+	}
+	else
+	{
+		fprintf(stdout, "Collector at %s:%d not answering, nothing to compare\n", addr, qport);
+	}
+	free(seq);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+/** @brief Gh buffered log writer
+ *  @file ghlog.c
+ *  @details Keeps the log file open and batches lines in memory. The
+ *           buffer is written with one write() once it holds flushsz bytes
+ *           or its oldest line is flushage seconds old. With fsyncevery
+ *           set to N, every Nth flush is followed by fdatasync().
+ */
+#include "ghlog.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int GhLogOpen(logger_s * lg, const char * fname, size_t flushsz, int flushage, int fsyncevery)
+{
+	lg->fd = open(fname, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (lg->fd < 0)
+	{
+		return 0;
+	}
+	strncpy(lg->fname, fname, sizeof(lg->fname) - 1);
+	lg->fname[sizeof(lg->fname) - 1] = '\0';
+	if (flushsz > GHLOGBUFSZ - GHLOGLINESZ)
+	{
+		flushsz = GHLOGBUFSZ - GHLOGLINESZ;
+	}
+	lg->flushsz = flushsz;
+	lg->flushage = flushage;
+	lg->fsyncevery = fsyncevery;
+	lg->flushes = 0;
+	lg->oldest = 0;
+	lg->psec = -1;
+	lg->len = 0;
+	return 1;
+}
+
+/** @brief Formats the ctime() prefix once per second into the cache.
+ */
+static void GhLogPrefix(logger_s * lg, time_t rtime)
+{
+	char ltime[CTIMESTRSZ + 1];
+
+	if (rtime == lg->psec)
+	{
+		return;
+	}
+	ctime_r(&rtime, ltime);
+	ltime[3] = ',';
+	ltime[7] = ',';
+	ltime[10] = ',';
+	ltime[19] = ',';
+	memcpy(lg->prefix, ltime, 24);
+	lg->prefix[24] = '\0';
+	lg->psec = rtime;
+}
+
+int GhLogAppend(logger_s * lg, reading_s ghdata)
+{
+	int n;
+
+	if (lg->fd < 0)
+	{
+		return 0;
+	}
+	GhLogPrefix(lg, ghdata.rtime);
+	if (lg->len == 0)
+	{
+		lg->oldest = ghdata.rtime;
+	}
+	n = snprintf(lg->buf + lg->len, GHLOGBUFSZ - lg->len, "\n%.24s,%5.1lf,%5.1lf,%6.1lf",
+			lg->prefix, ghdata.temperature, ghdata.humidity, ghdata.pressure);
+	if (n < 0 || (size_t)n >= GHLOGBUFSZ - lg->len)
+	{
+		// Out of room: push what we have and format again at the front
+		if (!GhLogFlush(lg))
+		{
+			return 0;
+		}
+		lg->oldest = ghdata.rtime;
+		n = snprintf(lg->buf, GHLOGBUFSZ, "\n%.24s,%5.1lf,%5.1lf,%6.1lf",
+				lg->prefix, ghdata.temperature, ghdata.humidity, ghdata.pressure);
+	}
+	lg->len += n;
+	if (lg->len >= lg->flushsz || ghdata.rtime - lg->oldest >= lg->flushage)
+	{
+		return GhLogFlush(lg);
+	}
+	return 1;
+}
+
+int GhLogFlush(logger_s * lg)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	if (lg->fd < 0)
+	{
+		return 0;
+	}
+	while (done < lg->len)
+	{
+		n = write(lg->fd, lg->buf + done, lg->len - done);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			memmove(lg->buf, lg->buf + done, lg->len - done);
+			lg->len -= done;
+			return 0;
+		}
+		done += n;
+	}
+	lg->len = 0;
+	if (done > 0 && lg->fsyncevery > 0 && ++lg->flushes >= lg->fsyncevery)
+	{
+		fdatasync(lg->fd);
+		lg->flushes = 0;
+	}
+	return 1;
+}
+
+void GhLogClose(logger_s * lg)
+{
+	if (lg->fd < 0)
+	{
+		return;
+	}
+	GhLogFlush(lg);
+	if (lg->fsyncevery > 0)
+	{
+		fdatasync(lg->fd);
+	}
+	close(lg->fd);
+	lg->fd = -1;
+}
+
+/** @brief Records an update period change in the .rate file next to the log.
+ *  @details Same time format as the log lines, then the period in
+ *           milliseconds and why it changed. Changes are rare, so the file
+ *           is opened for each one.
+ */
+int GhLogRate(const char * fname, time_t rtime, int period, const char * reason)
+{
+	char rname[GHLOGFNAMESZ];
+	char line[GHLOGLINESZ];
+	char ltime[CTIMESTRSZ + 1];
+	int fd, n, ok;
+
+	GhLogSidecarName(rname, sizeof(rname), fname, "rate");
+	fd = open(rname, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	ctime_r(&rtime, ltime);
+	ltime[3] = ',';
+	ltime[7] = ',';
+	ltime[10] = ',';
+	ltime[19] = ',';
+	n = snprintf(line, sizeof(line), "\n%.24s,%d,%s", ltime, period, reason);
+	ok = n > 0 && write(fd, line, n) == n;
+	close(fd);
+	return ok;
+}
+
+/** @brief Names a file that sits next to the log, e.g. ghdata.txt -> ghdata.blk
+ */
+void GhLogSidecarName(char * buf, size_t bufsz, const char * fname, const char * suffix)
+{
+	const char * dot;
+	const char * slash;
+	int baselen;
+
+	dot = strrchr(fname, '.');
+	slash = strrchr(fname, '/');
+	if (dot == NULL || (slash != NULL && dot < slash))
+	{
+		baselen = strlen(fname);
+	}
+	else
+	{
+		baselen = dot - fname;
+	}
+	snprintf(buf, bufsz, "%.*s.%s", baselen, fname, suffix);
+}
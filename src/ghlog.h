@@ -0,0 +1,51 @@
+/** @brief Gh buffered log writer constants, structures, function prototypes
+ *  @file ghlog.h
+ */
+
+#ifndef GHLOG_H
+#define GHLOG_H
+
+// Includes
+//
+#include <stddef.h>
+#include <time.h>
+#include "ghcontrol.h"
+
+// Constants
+
+#define GHLOGBUFSZ 4096
+#define GHLOGLINESZ 64
+#define GHLOGFNAMESZ 256
+#define GHLOGFLUSHSZ 2048
+#define GHLOGFLUSHAGE 60
+#define GHLOGFSYNC 0
+
+// Structures
+
+typedef struct logger
+{
+	int fd;
+	char fname[GHLOGFNAMESZ];
+	size_t flushsz;
+	int flushage;
+	int fsyncevery;
+	int flushes;
+	time_t oldest;
+	time_t psec;
+	char prefix[CTIMESTRSZ];
+	size_t len;
+	char buf[GHLOGBUFSZ];
+}logger_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+int GhLogOpen(logger_s * lg, const char * fname, size_t flushsz, int flushage, int fsyncevery);
+int GhLogAppend(logger_s * lg, reading_s ghdata);
+int GhLogFlush(logger_s * lg);
+void GhLogClose(logger_s * lg);
+int GhLogRate(const char * fname, time_t rtime, int period, const char * reason);
+void GhLogSidecarName(char * buf, size_t bufsz, const char * fname, const char * suffix);
+
+///@endcond
+#endif
@@ -0,0 +1,296 @@
+/** @brief Gh multicast readings
+ *  @file ghmcast.c
+ *  @details Every reading can go out as one fixed-size UDP datagram to a
+ *           multicast group, so a site collector hears all controllers
+ *           without polling them. The record is big-endian:
+ *
+ *               0  "GHMC"        4  version    5  stale bits  6  controls
+ *               7  zone (which part of the site the station is in)
+ *               8  station (serial number)     16 sequence
+ *               20 ntime (realtime ns)
+ *               28 temperature  32 humidity  36 pressure (IEEE float bits)
+ *               40 CRC-32 of bytes 0..39
+ *
+ *           Receivers take up to GHMCASTBATCH datagrams per recvmmsg()
+ *           call and drop any that are truncated, of another version, or
+ *           fail the checksum.
+ */
+#include "ghmcast.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static uint32_t ghcrctable[256];
+static pthread_once_t ghcrconce = PTHREAD_ONCE_INIT;
+
+static void GhCrcInit(void)
+{
+	uint32_t c;
+	int i, k;
+
+	for (i = 0; i < 256; i++)
+	{
+		c = i;
+		for (k = 0; k < 8; k++)
+		{
+			c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		}
+		ghcrctable[i] = c;
+	}
+}
+
+/** @brief CRC-32 as in zlib and Ethernet.
+ */
+uint32_t GhCrc32(const void * data, size_t len)
+{
+	const uint8_t * p = (const uint8_t *)data;
+	uint32_t c = 0xFFFFFFFFu;
+
+	pthread_once(&ghcrconce, GhCrcInit);
+	while (len-- > 0)
+	{
+		c = ghcrctable[(c ^ *p++) & 0xFF] ^ (c >> 8);
+	}
+	return c ^ 0xFFFFFFFFu;
+}
+
+static void GhMcastPut32(uint8_t * p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t GhMcastGet32(const uint8_t * p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void GhMcastPutFloat(uint8_t * p, float v)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &v, sizeof(bits));
+	GhMcastPut32(p, bits);
+}
+
+static float GhMcastGetFloat(const uint8_t * p)
+{
+	uint32_t bits;
+	float v;
+
+	bits = GhMcastGet32(p);
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+void GhMcastEncode(uint8_t * buf, const mcastrecord_s * rec)
+{
+	memcpy(buf, GHMCASTMAGIC, 4);
+	buf[4] = GHMCASTVERSION;
+	buf[5] = rec->stale;
+	buf[6] = rec->controls;
+	buf[7] = rec->zone;
+	GhMcastPut32(buf + 8, rec->station >> 32);
+	GhMcastPut32(buf + 12, rec->station);
+	GhMcastPut32(buf + 16, rec->seq);
+	GhMcastPut32(buf + 20, (uint64_t)rec->ntime >> 32);
+	GhMcastPut32(buf + 24, rec->ntime);
+	GhMcastPutFloat(buf + 28, rec->temperature);
+	GhMcastPutFloat(buf + 32, rec->humidity);
+	GhMcastPutFloat(buf + 36, rec->pressure);
+	GhMcastPut32(buf + 40, GhCrc32(buf, 40));
+}
+
+/** @return 1 if buf holds a valid record, 0 if it must be dropped
+ */
+int GhMcastDecode(const uint8_t * buf, size_t len, mcastrecord_s * rec)
+{
+	if (len != GHMCASTRECSZ || memcmp(buf, GHMCASTMAGIC, 4) != 0 || buf[4] != GHMCASTVERSION
+			|| GhMcastGet32(buf + 40) != GhCrc32(buf, 40))
+	{
+		return 0;
+	}
+	rec->stale = buf[5];
+	rec->controls = buf[6];
+	rec->zone = buf[7];
+	rec->station = (uint64_t)GhMcastGet32(buf + 8) << 32 | GhMcastGet32(buf + 12);
+	rec->seq = GhMcastGet32(buf + 16);
+	rec->ntime = (int64_t)((uint64_t)GhMcastGet32(buf + 20) << 32 | GhMcastGet32(buf + 24));
+	rec->temperature = GhMcastGetFloat(buf + 28);
+	rec->humidity = GhMcastGetFloat(buf + 32);
+	rec->pressure = GhMcastGetFloat(buf + 36);
+	return 1;
+}
+
+static int GhMcastAddress(struct sockaddr_in * sin, const char * addr, int port)
+{
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(port);
+	if (addr == NULL)
+	{
+		sin->sin_addr.s_addr = htonl(INADDR_ANY);
+		return 1;
+	}
+	return inet_pton(AF_INET, addr, &sin->sin_addr) == 1;
+}
+
+/** @brief Opens a socket that sends to group:port.
+ *  @param ifaddr the interface address to send from, NULL for the default
+ *         route, "127.0.0.1" to keep the traffic on this host
+ *  @param zone 0..GHMCASTZONES-1, lets a collector aggregate by zone
+ *  @return 1 on success, 0 on failure
+ */
+int GhMcastOpen(mcastsender_s * ms, const char * group, int port, const char * ifaddr, uint64_t station, int zone)
+{
+	struct sockaddr_in sin;
+	struct in_addr iface;
+	unsigned char ttl = GHMCASTTTL, loop = 1;
+
+	memset(ms, 0, sizeof(*ms));
+	ms->station = station;
+	ms->zone = zone & (GHMCASTZONES - 1);
+	ms->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (ms->fd < 0)
+	{
+		return 0;
+	}
+	if (!GhMcastAddress(&sin, group, port)
+			|| setsockopt(ms->fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0
+			|| setsockopt(ms->fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0
+			|| (ifaddr != NULL && (inet_pton(AF_INET, ifaddr, &iface) != 1
+				|| setsockopt(ms->fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0))
+			|| connect(ms->fd, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+	{
+		GhMcastClose(ms);
+		return 0;
+	}
+	return 1;
+}
+
+/** @brief Sends one reading; never blocks, a full socket buffer drops it.
+ */
+int GhMcastSend(mcastsender_s * ms, reading_s rd, control_s ctrl)
+{
+	uint8_t buf[GHMCASTRECSZ];
+	mcastrecord_s rec;
+
+	if (ms->fd < 0)
+	{
+		return 0;
+	}
+	rec.station = ms->station;
+	rec.zone = ms->zone;
+	rec.seq = ms->seq++;
+	rec.ntime = rd.ntime;
+	rec.temperature = rd.temperature;
+	rec.humidity = rd.humidity;
+	rec.pressure = rd.pressure;
+	rec.stale = rd.stale;
+	rec.controls = (ctrl.heater ? GHMCASTHEATER : 0) | (ctrl.humidifier ? GHMCASTHUMIDIFIER : 0);
+	GhMcastEncode(buf, &rec);
+	if (send(ms->fd, buf, sizeof(buf), 0) != sizeof(buf))
+	{
+		ms->failed++;
+		return 0;
+	}
+	ms->sent++;
+	return 1;
+}
+
+void GhMcastClose(mcastsender_s * ms)
+{
+	if (ms->fd >= 0)
+	{
+		close(ms->fd);
+	}
+	ms->fd = -1;
+}
+
+/** @brief Joins group on ifaddr (NULL for any interface) and binds port.
+ *  @details The socket is non-blocking; poll it for EPOLLIN, then call
+ *           GhMcastReceive() until it returns less than GHMCASTBATCH.
+ *  @return 1 on success, 0 on failure
+ */
+int GhMcastListen(mcastreceiver_s * mr, const char * group, int port, const char * ifaddr)
+{
+	struct sockaddr_in sin;
+	struct ip_mreq mreq;
+	int i, on = 1, rcvbuf = GHMCASTRCVBUF;
+
+	memset(mr, 0, sizeof(*mr));
+	mr->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (mr->fd < 0)
+	{
+		return 0;
+	}
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	// Bursts from many stations arrive together; the kernel may cap this
+	setsockopt(mr->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	if (setsockopt(mr->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+			|| !GhMcastAddress(&sin, group, port)
+			|| bind(mr->fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+			|| (ifaddr != NULL && inet_pton(AF_INET, ifaddr, &mreq.imr_interface) != 1))
+	{
+		GhMcastUnlisten(mr);
+		return 0;
+	}
+	mreq.imr_multiaddr = sin.sin_addr;
+	if (setsockopt(mr->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+	{
+		GhMcastUnlisten(mr);
+		return 0;
+	}
+	for (i = 0; i < GHMCASTBATCH; i++)
+	{
+		mr->iov[i].iov_base = mr->buf[i];
+		mr->iov[i].iov_len = GHMCASTRECSZ;
+		mr->msg[i].msg_hdr.msg_iov = &mr->iov[i];
+		mr->msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	return 1;
+}
+
+/** @brief Takes one batch of datagrams and hands each valid record to fn.
+ *  @return the number of datagrams taken, 0 when none are waiting, -1 on error
+ */
+int GhMcastReceive(mcastreceiver_s * mr, ghmcast_fn fn, void * arg)
+{
+	mcastrecord_s rec;
+	int i, n;
+
+	n = recvmmsg(mr->fd, mr->msg, GHMCASTBATCH, MSG_DONTWAIT, NULL);
+	if (n < 0)
+	{
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+	}
+	mr->batches++;
+	for (i = 0; i < n; i++)
+	{
+		// A longer datagram is cut to the record size and flagged
+		if ((mr->msg[i].msg_hdr.msg_flags & MSG_TRUNC)
+				|| !GhMcastDecode(mr->buf[i], mr->msg[i].msg_len, &rec))
+		{
+			mr->bad++;
+			continue;
+		}
+		mr->records++;
+		fn(&rec, arg);
+	}
+	return n;
+}
+
+void GhMcastUnlisten(mcastreceiver_s * mr)
+{
+	if (mr->fd >= 0)
+	{
+		close(mr->fd);
+	}
+	mr->fd = -1;
+}
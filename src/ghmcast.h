@@ -0,0 +1,82 @@
+/** @brief Gh multicast readings constants, structures, function prototypes
+ *  @file ghmcast.h
+ */
+
+#ifndef GHMCAST_H
+#define GHMCAST_H
+
+// Includes
+//
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "ghcontrol.h"
+
+// Constants
+
+#define GHMCASTGROUP "239.255.42.99"
+#define GHMCASTPORT 4299
+#define GHMCASTTTL 1
+#define GHMCASTMAGIC "GHMC"
+#define GHMCASTVERSION 1
+#define GHMCASTRECSZ 44
+#define GHMCASTBATCH 64
+#define GHMCASTRCVBUF (4 * 1024 * 1024)
+#define GHMCASTHEATER 0x01
+#define GHMCASTHUMIDIFIER 0x02
+#define GHMCASTZONES 256
+
+// Structures
+
+typedef struct mcastrecord
+{
+	uint64_t station;
+	uint32_t seq;
+	int64_t ntime;
+	float temperature;
+	float humidity;
+	float pressure;
+	int stale;
+	int controls;
+	int zone;
+}mcastrecord_s;
+
+typedef struct mcastsender
+{
+	int fd;
+	uint64_t station;
+	int zone;
+	uint32_t seq;
+	unsigned long sent;
+	unsigned long failed;
+}mcastsender_s;
+
+typedef void (*ghmcast_fn)(const mcastrecord_s * rec, void * arg);
+
+typedef struct mcastreceiver
+{
+	int fd;
+	unsigned long records;
+	unsigned long bad;
+	unsigned long batches;
+	struct mmsghdr msg[GHMCASTBATCH];
+	struct iovec iov[GHMCASTBATCH];
+	uint8_t buf[GHMCASTBATCH][GHMCASTRECSZ];
+}mcastreceiver_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+uint32_t GhCrc32(const void * data, size_t len);
+void GhMcastEncode(uint8_t * buf, const mcastrecord_s * rec);
+int GhMcastDecode(const uint8_t * buf, size_t len, mcastrecord_s * rec);
+int GhMcastOpen(mcastsender_s * ms, const char * group, int port, const char * ifaddr, uint64_t station, int zone);
+int GhMcastSend(mcastsender_s * ms, reading_s rd, control_s ctrl);
+void GhMcastClose(mcastsender_s * ms);
+int GhMcastListen(mcastreceiver_s * mr, const char * group, int port, const char * ifaddr);
+int GhMcastReceive(mcastreceiver_s * mr, ghmcast_fn fn, void * arg);
+void GhMcastUnlisten(mcastreceiver_s * mr);
+
+///@endcond
+#endif
@@ -0,0 +1,131 @@
+/** @brief Gh adaptive sampling policy
+ *  @file ghrate.c
+ *  @details Decides the update period from how the readings behave. After
+ *           GHRATECALM updates in a row where every field moved less than
+ *           its step threshold and its running standard deviation stayed
+ *           low, the period doubles, up to maxperiod. Moderate movement
+ *           halves it. A large jump, a reading near a setpoint or a
+ *           setpoint edit snaps it back to minperiod. An update with no
+ *           valid field counts as movement, so dead sensors never slow the
+ *           period down.
+ */
+#include "ghrate.h"
+#include <math.h>
+#include <string.h>
+
+static const float ghstep[SENSORS] = {GHRATESTEPTEMP, GHRATESTEPHUMID, GHRATESTEPPRESS};
+static const float ghsd[SENSORS] = {GHRATESDTEMP, GHRATESDHUMID, GHRATESDPRESS};
+static const float ghsnap[SENSORS] = {GHRATESNAPTEMP, GHRATESNAPHUMID, GHRATESNAPPRESS};
+static const char * ghreasons[GHRATEREASONS] = {"hold", "slower", "faster", "change", "near", "edit"};
+
+void GhRateInit(ratepolicy_s * rp, int minperiod, int maxperiod)
+{
+	memset(rp, 0, sizeof(*rp));
+	rp->minperiod = minperiod;
+	rp->maxperiod = maxperiod < minperiod ? minperiod : maxperiod;
+	rp->period = minperiod;
+}
+
+const char * GhRateReason(int reason)
+{
+	if (reason < 0 || reason >= GHRATEREASONS)
+	{
+		return "?";
+	}
+	return ghreasons[reason];
+}
+
+/** @brief Goes back to the fastest period at once.
+ *  @return the new period in milliseconds
+ */
+int GhRateReset(ratepolicy_s * rp, int reason)
+{
+	rp->period = rp->minperiod;
+	rp->calm = 0;
+	rp->reason = reason;
+	rp->decisions[reason]++;
+	return rp->period;
+}
+
+/** @brief Feeds one reading to the policy.
+ *  @return the period in milliseconds to use from now on
+ */
+int GhRateUpdate(ratepolicy_s * rp, reading_s rd, setpoint_s sp)
+{
+	float v[SENSORS];
+	float d, delta;
+	int i, calm = 1, jump = 0, valid = 0;
+
+	v[TEMPERATURE] = rd.temperature;
+	v[HUMIDITY] = rd.humidity;
+	v[PRESSURE] = rd.pressure;
+	if (!rp->primed)
+	{
+		memcpy(rp->prev, v, sizeof(v));
+		memcpy(rp->mean, v, sizeof(v));
+		rp->primed = 1;
+		return GhRateReset(rp, GHRATECHANGE);
+	}
+	for (i = 0; i < SENSORS; i++)
+	{
+		if ((rd.stale >> i) & 1 || isnan(v[i]))
+		{
+			continue;
+		}
+		valid++;
+		if (isnan(rp->prev[i]))
+		{
+			// First good value of a field that was primed stale
+			rp->prev[i] = v[i];
+			rp->mean[i] = v[i];
+			rp->var[i] = 0;
+			calm = 0;
+			continue;
+		}
+		delta = fabsf(v[i] - rp->prev[i]);
+		d = v[i] - rp->mean[i];
+		rp->mean[i] += GHRATEALPHA * d;
+		rp->var[i] = (1 - GHRATEALPHA) * (rp->var[i] + GHRATEALPHA * d * d);
+		rp->prev[i] = v[i];
+		if (delta > ghsnap[i])
+		{
+			jump = 1;
+		}
+		if (delta > ghstep[i] || sqrtf(rp->var[i]) > ghsd[i])
+		{
+			calm = 0;
+		}
+	}
+	if (valid == 0)
+	{
+		// Nothing to judge calm by: never back off blind
+		calm = 0;
+	}
+	if (jump)
+	{
+		return GhRateReset(rp, GHRATECHANGE);
+	}
+	if (fabsf(rd.temperature - sp.temperature) < GHRATENEARTEMP
+		|| fabsf(rd.humidity - sp.humidity) < GHRATENEARHUMID)
+	{
+		return GhRateReset(rp, GHRATENEAR);
+	}
+	if (!calm)
+	{
+		rp->calm = 0;
+		rp->reason = rp->period > rp->minperiod ? GHRATEFASTER : GHRATEHOLD;
+		rp->period = rp->period / 2 < rp->minperiod ? rp->minperiod : rp->period / 2;
+	}
+	else if (++rp->calm >= GHRATECALM && rp->period < rp->maxperiod)
+	{
+		rp->calm = 0;
+		rp->reason = GHRATESLOWER;
+		rp->period = rp->period * 2 > rp->maxperiod ? rp->maxperiod : rp->period * 2;
+	}
+	else
+	{
+		rp->reason = GHRATEHOLD;
+	}
+	rp->decisions[rp->reason]++;
+	return rp->period;
+}
@@ -0,0 +1,67 @@
+/** @brief Gh adaptive sampling policy constants, structures, function prototypes
+ *  @file ghrate.h
+ */
+
+#ifndef GHRATE_H
+#define GHRATE_H
+
+// Includes
+//
+#include <time.h>
+#include "ghcontrol.h"
+
+// Constants
+
+#define GHRATEMIN GHUPDATE
+#define GHRATEMAX 60000
+#define GHRATECALM 5
+#define GHRATEALPHA 0.2f
+// Largest change per update that still counts as calm
+#define GHRATESTEPTEMP 0.2f
+#define GHRATESTEPHUMID 0.5f
+#define GHRATESTEPPRESS 0.2f
+// Largest standard deviation that still counts as calm
+#define GHRATESDTEMP 0.15f
+#define GHRATESDHUMID 0.5f
+#define GHRATESDPRESS 0.3f
+// A change this large, or a reading this close to a setpoint, goes fast
+#define GHRATESNAPTEMP 1.0f
+#define GHRATESNAPHUMID 3.0f
+#define GHRATESNAPPRESS 1.0f
+#define GHRATENEARTEMP 1.0f
+#define GHRATENEARHUMID 3.0f
+
+#define GHRATEHOLD 0
+#define GHRATESLOWER 1
+#define GHRATEFASTER 2
+#define GHRATECHANGE 3
+#define GHRATENEAR 4
+#define GHRATEEDIT 5
+#define GHRATEREASONS 6
+
+// Structures
+
+typedef struct ratepolicy
+{
+	int period;
+	int minperiod;
+	int maxperiod;
+	int primed;
+	int calm;
+	int reason;
+	float prev[SENSORS];
+	float mean[SENSORS];
+	float var[SENSORS];
+	unsigned long decisions[GHRATEREASONS];
+}ratepolicy_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+void GhRateInit(ratepolicy_s * rp, int minperiod, int maxperiod);
+int GhRateUpdate(ratepolicy_s * rp, reading_s rd, setpoint_s sp);
+int GhRateReset(ratepolicy_s * rp, int reason);
+const char * GhRateReason(int reason);
+
+///@endcond
+#endif
@@ -0,0 +1,113 @@
+/** @brief Gh recent readings ring
+ *  @file ghring.c
+ *  @details Fixed-capacity history with one writer and any number of
+ *           readers. Each slot carries a sequence number derived from the
+ *           absolute index it holds: 2*idx+1 while it is being written and
+ *           2*idx+2 once complete. A reader copies a slot and checks that
+ *           the sequence did not move, so it never waits on the writer; a
+ *           slot that was overwritten meanwhile is reported as missing.
+ */
+#include "ghring.h"
+#include <string.h>
+
+void GhRingInit(ring_s * rg)
+{
+	memset(rg, 0, sizeof(*rg));
+}
+
+void GhRingPush(ring_s * rg, reading_s rd)
+{
+	uint64_t idx;
+	ringslot_s * sp;
+
+	idx = __atomic_load_n(&rg->head, __ATOMIC_RELAXED);
+	sp = &rg->slot[idx % GHRINGSIZE];
+	__atomic_store_n(&sp->seq, 2 * idx + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	sp->rd = rd;
+	__atomic_store_n(&sp->seq, 2 * idx + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&rg->head, idx + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t GhRingHead(const ring_s * rg)
+{
+	return __atomic_load_n(&rg->head, __ATOMIC_ACQUIRE);
+}
+
+/** @brief Copies the reading at absolute index idx.
+ *  @return 1 on success, 0 if idx is not written yet or already overwritten
+ */
+int GhRingGet(const ring_s * rg, uint64_t idx, reading_s * rd)
+{
+	const ringslot_s * sp;
+	uint64_t seq;
+
+	sp = &rg->slot[idx % GHRINGSIZE];
+	seq = __atomic_load_n(&sp->seq, __ATOMIC_ACQUIRE);
+	if (seq != 2 * idx + 2)
+	{
+		return 0;
+	}
+	memcpy(rd, (const void *)&sp->rd, sizeof(*rd));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&sp->seq, __ATOMIC_RELAXED) == seq;
+}
+
+int GhRingLatest(const ring_s * rg, reading_s * rd)
+{
+	uint64_t head;
+
+	head = GhRingHead(rg);
+	return head > 0 && GhRingGet(rg, head - 1, rd);
+}
+
+/** @brief Copies up to max of the most recent readings, oldest first.
+ *  @return the number of readings copied
+ */
+size_t GhRingRecent(const ring_s * rg, reading_s * out, size_t max)
+{
+	uint64_t head, idx;
+	size_t n = 0;
+
+	head = GhRingHead(rg);
+	if (max > GHRINGSIZE)
+	{
+		max = GHRINGSIZE;
+	}
+	idx = head > max ? head - max : 0;
+	for (; idx < head; idx++)
+	{
+		if (GhRingGet(rg, idx, &out[n]))
+		{
+			n++;
+		}
+	}
+	return n;
+}
+
+/** @brief First index holding a reading at or after ntime (binary search).
+ *  @details Readings are pushed in time order; slots already overwritten
+ *           count as older than anything asked for.
+ */
+uint64_t GhRingLowerBound(const ring_s * rg, int64_t ntime)
+{
+	uint64_t head, lo, hi, mid;
+	reading_s rd;
+
+	head = GhRingHead(rg);
+	lo = head > GHRINGSIZE ? head - GHRINGSIZE : 0;
+	hi = head;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (!GhRingGet(rg, mid, &rd) || rd.ntime < ntime)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
@@ -0,0 +1,44 @@
+/** @brief Gh recent readings ring constants, structures, function prototypes
+ *  @file ghring.h
+ */
+
+#ifndef GHRING_H
+#define GHRING_H
+
+// Includes
+//
+#include <stddef.h>
+#include <stdint.h>
+#include "ghcontrol.h"
+
+// Constants
+
+#define GHRINGSIZE (24 * 3600 * 1000 / GHUPDATE)
+
+// Structures
+
+typedef struct ringslot
+{
+	uint64_t seq;
+	reading_s rd;
+}ringslot_s;
+
+typedef struct ring
+{
+	uint64_t head;
+	ringslot_s slot[GHRINGSIZE];
+}ring_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+void GhRingInit(ring_s * rg);
+void GhRingPush(ring_s * rg, reading_s rd);
+uint64_t GhRingHead(const ring_s * rg);
+int GhRingGet(const ring_s * rg, uint64_t idx, reading_s * rd);
+int GhRingLatest(const ring_s * rg, reading_s * rd);
+size_t GhRingRecent(const ring_s * rg, reading_s * out, size_t max);
+uint64_t GhRingLowerBound(const ring_s * rg, int64_t ntime);
+
+///@endcond
+#endif
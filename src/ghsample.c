@@ -0,0 +1,278 @@
+/** @brief Gh oversampling sampler
+ *  @file ghsample.c
+ *  @details A thread reads the environmental sensors at close to their
+ *           output data rate and pushes timestamped samples into a
+ *           single-producer/single-consumer ring. Each GhSamplerRead()
+ *           drains what arrived since the last call and decimates it to one
+ *           reading with a mean, median or trimmed mean, so one noisy
+ *           conversion no longer reaches the display or the log.
+ *           The consumer never waits on the bus or the ring: a period
+ *           without samples returns the last good values marked stale at
+ *           once. The worker gives each sample GHSAMPLEDEADLINE ms including
+ *           retries; a read that finishes later is dropped as a stall.
+ */
+#include "ghsample.h"
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+
+#define NSPERSEC 1000000000LL
+#define NSPERMSEC 1000000LL
+
+static int64_t GhSampleNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * NSPERSEC + ts.tv_nsec;
+}
+
+static void GhSampleSleep(int64_t deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline / NSPERSEC;
+	ts.tv_nsec = deadline % NSPERSEC;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+	{
+	}
+}
+
+/** @brief Producer side; a full ring drops the new sample rather than
+ *         touching the consumer's tail.
+ */
+static void GhSamplePush(sampler_s * sm, const sample_s * sp)
+{
+	uint64_t head, tail;
+
+	head = __atomic_load_n(&sm->head, __ATOMIC_RELAXED);
+	tail = __atomic_load_n(&sm->tail, __ATOMIC_ACQUIRE);
+	if (head - tail >= GHSAMPLERING)
+	{
+		__atomic_fetch_add(&sm->stats.dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	sm->slot[head % GHSAMPLERING] = *sp;
+	__atomic_store_n(&sm->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void * GhSampleThread(void * arg)
+{
+	sampler_s * sm = (sampler_s *)arg;
+	sample_s s;
+	int64_t period, next, now, deadline;
+	int tries, ok;
+
+	next = GhSampleNow();
+	while (!__atomic_load_n(&sm->stop, __ATOMIC_ACQUIRE))
+	{
+		period = NSPERSEC / __atomic_load_n(&sm->rate, __ATOMIC_RELAXED);
+		deadline = GhSampleNow() + GHSAMPLEDEADLINE * NSPERMSEC;
+		for (tries = 0; tries <= GHSAMPLERETRIES; tries++)
+		{
+			if (tries > 0)
+			{
+				if (GhSampleNow() >= deadline)
+				{
+					// No time left for another attempt this period
+					break;
+				}
+				__atomic_fetch_add(&sm->stats.retries, 1, __ATOMIC_RELAXED);
+			}
+			ok = sm->read(&s, sm->arg);
+			if (GhSampleNow() > deadline)
+			{
+				// Too late to describe this period; never hand it on
+				__atomic_fetch_add(&sm->stats.stalls, 1, __ATOMIC_RELAXED);
+				break;
+			}
+			if (ok)
+			{
+				GhSamplePush(sm, &s);
+				break;
+			}
+		}
+		next += period;
+		now = GhSampleNow();
+		if (next < now)
+		{
+			// Fell behind (slow bus); keep the rate, not the backlog
+			next = now;
+		}
+		GhSampleSleep(next);
+	}
+	return NULL;
+}
+
+int GhSamplerStart(sampler_s * sm, int rate, int method, ghread_fn read, void * arg)
+{
+	sigset_t mask, saved;
+	int err;
+
+	memset(sm, 0, sizeof(*sm));
+	sm->rate = rate > 0 ? rate : GHSAMPLERATE;
+	sm->method = method;
+	sm->trim = GHSAMPLETRIM;
+	sm->read = read;
+	sm->arg = arg;
+	sm->last.sampled = 0;
+	sm->last.temperature = NAN;
+	sm->last.humidity = NAN;
+	sm->last.pressure = NAN;
+	sm->last.stale = (1 << TEMPERATURE) | (1 << HUMIDITY) | (1 << PRESSURE);
+	// The thread inherits the mask: SIGINT and SIGTERM stay with the main loop
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, &saved);
+	err = pthread_create(&sm->thread, NULL, GhSampleThread, sm);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (err != 0)
+	{
+		return 0;
+	}
+	sm->running = 1;
+	return 1;
+}
+
+void GhSamplerStop(sampler_s * sm)
+{
+	if (!sm->running)
+	{
+		return;
+	}
+	__atomic_store_n(&sm->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(sm->thread, NULL);
+	sm->running = 0;
+}
+
+/** @brief Reduces n values to one, ignoring NaNs. Sorts v in place.
+ *  @return the decimated value, or NaN if no value was valid
+ */
+float GhSampleDecimate(float * v, int n, int method, float trim)
+{
+	int i, j, m, lo, hi;
+	float x, sum;
+
+	for (i = 0, m = 0; i < n; i++)
+	{
+		if (!isnan(v[i]))
+		{
+			v[m++] = v[i];
+		}
+	}
+	if (m == 0)
+	{
+		return NAN;
+	}
+	lo = 0;
+	hi = m;
+	if (method != GHSAMPLEMEAN)
+	{
+		// Insertion sort; a period holds at most GHSAMPLERING values
+		for (i = 1; i < m; i++)
+		{
+			x = v[i];
+			for (j = i; j > 0 && v[j - 1] > x; j--)
+			{
+				v[j] = v[j - 1];
+			}
+			v[j] = x;
+		}
+		if (method == GHSAMPLEMEDIAN)
+		{
+			return m % 2 ? v[m / 2] : (v[m / 2 - 1] + v[m / 2]) / 2;
+		}
+		lo = (int)(m * trim);
+		hi = m - lo;
+	}
+	for (i = lo, sum = 0; i < hi; i++)
+	{
+		sum += v[i];
+	}
+	return sum / (hi - lo);
+}
+
+/** @brief Decimates the samples taken since the previous call.
+ *  @details Never blocks: with nothing in the ring it returns the previous
+ *           reading with every stale bit set. A field with no valid sample
+ *           keeps its previous value and has its bit set in rd->stale.
+ *           rd->sampled is the monotonic time of the newest sample with a
+ *           valid field; the caller stamps the update itself.
+ *  @return the number of samples used, 0 if rd holds the previous reading
+ */
+int GhSamplerRead(sampler_s * sm, reading_s * rd)
+{
+	float t[GHSAMPLERING], h[GHSAMPLERING], p[GHSAMPLERING];
+	uint64_t head, tail;
+	const sample_s * sp;
+	int64_t newest = 0;
+	float v;
+	int n;
+
+	tail = sm->tail;
+	head = __atomic_load_n(&sm->head, __ATOMIC_ACQUIRE);
+	for (n = 0; tail != head; tail++, n++)
+	{
+		sp = &sm->slot[tail % GHSAMPLERING];
+		t[n] = sp->temperature;
+		h[n] = sp->humidity;
+		p[n] = sp->pressure;
+		sm->stats.nans += isnan(t[n]) + isnan(h[n]) + isnan(p[n]);
+		newest = sp->mtime;
+	}
+	__atomic_store_n(&sm->tail, tail, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&sm->stats.samples, n, __ATOMIC_RELAXED);
+	if (n == 0)
+	{
+		__atomic_fetch_add(&sm->stats.timeouts, 1, __ATOMIC_RELAXED);
+	}
+	sm->last.stale = (1 << TEMPERATURE) | (1 << HUMIDITY) | (1 << PRESSURE);
+	v = GhSampleDecimate(t, n, sm->method, sm->trim);
+	if (!isnan(v))
+	{
+		sm->last.temperature = v;
+		sm->last.stale &= ~(1 << TEMPERATURE);
+	}
+	v = GhSampleDecimate(h, n, sm->method, sm->trim);
+	if (!isnan(v))
+	{
+		sm->last.humidity = v;
+		sm->last.stale &= ~(1 << HUMIDITY);
+	}
+	v = GhSampleDecimate(p, n, sm->method, sm->trim);
+	if (!isnan(v))
+	{
+		sm->last.pressure = v;
+		sm->last.stale &= ~(1 << PRESSURE);
+	}
+	if (sm->last.stale != ((1 << TEMPERATURE) | (1 << HUMIDITY) | (1 << PRESSURE)))
+	{
+		sm->last.sampled = newest;
+	}
+	*rd = sm->last;
+	return n;
+}
+
+/** @brief Changes the sampling rate from the next sample on.
+ */
+void GhSamplerSetRate(sampler_s * sm, int rate)
+{
+	if (rate > 0)
+	{
+		__atomic_store_n(&sm->rate, rate, __ATOMIC_RELAXED);
+	}
+}
+
+/** @brief Copies the sampler counters; safe while the thread runs.
+ */
+void GhSamplerStats(sampler_s * sm, sensorstats_s * st)
+{
+	st->samples = __atomic_load_n(&sm->stats.samples, __ATOMIC_RELAXED);
+	st->nans = sm->stats.nans;
+	st->retries = __atomic_load_n(&sm->stats.retries, __ATOMIC_RELAXED);
+	st->timeouts = __atomic_load_n(&sm->stats.timeouts, __ATOMIC_RELAXED);
+	st->stalls = __atomic_load_n(&sm->stats.stalls, __ATOMIC_RELAXED);
+	st->dropped = __atomic_load_n(&sm->stats.dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,68 @@
+/** @brief Gh oversampling sampler constants, structures, function prototypes
+ *  @file ghsample.h
+ */
+
+#ifndef GHSAMPLE_H
+#define GHSAMPLE_H
+
+// Includes
+//
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "ghcontrol.h"
+
+// Constants
+
+#define GHSAMPLERATE 25
+#define GHSAMPLERING 128
+#define GHSAMPLEMEAN 0
+#define GHSAMPLEMEDIAN 1
+#define GHSAMPLETRIMMED 2
+#define GHSAMPLEMETHOD GHSAMPLETRIMMED
+#define GHSAMPLETRIM 0.2f
+#define GHSAMPLEDEADLINE 20
+#define GHSAMPLERETRIES 2
+
+// Structures
+
+typedef struct sample
+{
+	int64_t mtime;
+	float temperature;
+	float humidity;
+	float pressure;
+}sample_s;
+
+typedef int (*ghread_fn)(sample_s * sp, void * arg);
+
+typedef struct sampler
+{
+	pthread_t thread;
+	int running;
+	int stop;
+	int rate;
+	int method;
+	float trim;
+	ghread_fn read;
+	void * arg;
+	sensorstats_s stats;
+	reading_s last;
+	uint64_t head;
+	uint64_t tail;
+	sample_s slot[GHSAMPLERING];
+}sampler_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+int GhSamplerStart(sampler_s * sm, int rate, int method, ghread_fn read, void * arg);
+void GhSamplerStop(sampler_s * sm);
+int GhSamplerRead(sampler_s * sm, reading_s * rd);
+void GhSamplerStats(sampler_s * sm, sensorstats_s * st);
+void GhSamplerSetRate(sampler_s * sm, int rate);
+float GhSampleDecimate(float * v, int n, int method, float trim);
+
+///@endcond
+#endif
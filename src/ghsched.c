@@ -0,0 +1,312 @@
+/** @brief Gh periodic task scheduler
+ *  @file ghsched.c
+ *  @details Tasks run at their own period against absolute CLOCK_MONOTONIC
+ *           deadlines. A single timerfd is armed for the earliest deadline
+ *           and the process sleeps in epoll_wait() until it expires.
+ *           SIGINT and SIGTERM arrive through a signalfd so GhSchedRun()
+ *           returns and the caller can flush its state before exiting.
+ *           Other descriptors (joystick, sockets) can be added as sources;
+ *           their callbacks run as soon as epoll reports them.
+ */
+#include "ghsched.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+
+#define SRCTIMER UINT64_MAX
+#define SRCSIGNAL (UINT64_MAX - 1)
+
+int64_t GhSchedNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * NSPERSEC + ts.tv_nsec;
+}
+
+static int GhSchedArm(sched_s * sch, int64_t deadline)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / NSPERSEC;
+	its.it_value.tv_nsec = deadline % NSPERSEC;
+	return timerfd_settime(sch->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+int GhSchedInit(sched_s * sch)
+{
+	struct epoll_event ev;
+	sigset_t mask;
+	int i;
+
+	memset(sch, 0, sizeof(*sch));
+	sch->sfd = -1;
+	for (i = 0; i < GHMAXSOURCES; i++)
+	{
+		sch->sources[i].fd = -1;
+	}
+	sch->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (sch->epfd < 0)
+	{
+		return 0;
+	}
+	sch->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (sch->tfd < 0)
+	{
+		close(sch->epfd);
+		return 0;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = SRCTIMER;
+	if (epoll_ctl(sch->epfd, EPOLL_CTL_ADD, sch->tfd, &ev) < 0)
+	{
+		GhSchedClose(sch);
+		return 0;
+	}
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	sch->sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	ev.data.u64 = SRCSIGNAL;
+	if (sch->sfd < 0 || epoll_ctl(sch->epfd, EPOLL_CTL_ADD, sch->sfd, &ev) < 0)
+	{
+		GhSchedClose(sch);
+		return 0;
+	}
+	sch->epoch = GhSchedNow();
+	return 1;
+}
+
+int GhSchedAddTask(sched_s * sch, const char * name, int period, ghtask_fn run, void * arg)
+{
+	task_s * tp;
+
+	if (sch->ntasks >= GHMAXTASKS || period <= 0 || run == NULL)
+	{
+		return 0;
+	}
+	tp = &sch->tasks[sch->ntasks++];
+	tp->name = name;
+	tp->period = period * NSPERMS;
+	tp->deadline = sch->epoch;
+	tp->run = run;
+	tp->arg = arg;
+	tp->runs = 0;
+	tp->overruns = 0;
+	return 1;
+}
+
+/** @brief Changes the period of the task called name.
+ *  @details A task that is not due yet moves to one new period after its
+ *           last run, or to now if that has already passed, so a shorter
+ *           period takes effect at once. Called from a running task, the
+ *           new period applies from that run on.
+ */
+int GhSchedSetPeriod(sched_s * sch, const char * name, int period)
+{
+	int i;
+	int64_t now, last;
+	task_s * tp;
+
+	if (period <= 0)
+	{
+		return 0;
+	}
+	for (i = 0; i < sch->ntasks; i++)
+	{
+		tp = &sch->tasks[i];
+		if (strcmp(tp->name, name) != 0)
+		{
+			continue;
+		}
+		now = GhSchedNow();
+		if (tp->deadline > now)
+		{
+			last = tp->deadline - tp->period;
+			tp->deadline = last + period * NSPERMS;
+			if (tp->deadline < now)
+			{
+				tp->deadline = now;
+			}
+		}
+		tp->period = period * NSPERMS;
+		return 1;
+	}
+	return 0;
+}
+
+int GhSchedAddFd(sched_s * sch, int fd, uint32_t events, ghfd_fn run, void * arg)
+{
+	struct epoll_event ev;
+	int i;
+
+	for (i = 0; i < GHMAXSOURCES; i++)
+	{
+		if (sch->sources[i].fd < 0)
+		{
+			break;
+		}
+	}
+	if (i == GHMAXSOURCES || fd < 0 || run == NULL)
+	{
+		return 0;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.u64 = i;
+	if (epoll_ctl(sch->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		return 0;
+	}
+	sch->sources[i].fd = fd;
+	sch->sources[i].run = run;
+	sch->sources[i].arg = arg;
+	return 1;
+}
+
+int GhSchedModFd(sched_s * sch, int fd, uint32_t events)
+{
+	struct epoll_event ev;
+	int i;
+
+	for (i = 0; i < GHMAXSOURCES; i++)
+	{
+		if (sch->sources[i].fd == fd)
+		{
+			memset(&ev, 0, sizeof(ev));
+			ev.events = events;
+			ev.data.u64 = i;
+			return epoll_ctl(sch->epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+		}
+	}
+	return 0;
+}
+
+/** @brief Stops watching fd. The caller still owns and closes it.
+ */
+void GhSchedDelFd(sched_s * sch, int fd)
+{
+	int i;
+
+	for (i = 0; i < GHMAXSOURCES; i++)
+	{
+		if (sch->sources[i].fd == fd)
+		{
+			epoll_ctl(sch->epfd, EPOLL_CTL_DEL, fd, NULL);
+			sch->sources[i].fd = -1;
+			return;
+		}
+	}
+}
+
+/** @brief Runs every task whose deadline has passed, in registration order.
+ *  @details Deadlines advance by whole periods from the epoch so they never
+ *           drift. Periods missed while a task ran long are counted, not
+ *           replayed.
+ */
+static int64_t GhSchedDispatch(sched_s * sch)
+{
+	int i;
+	int64_t now, missed, next;
+	task_s * tp;
+
+	now = GhSchedNow();
+	next = INT64_MAX;
+	for (i = 0; i < sch->ntasks; i++)
+	{
+		tp = &sch->tasks[i];
+		if (tp->deadline <= now)
+		{
+			tp->run(tp->arg);
+			tp->runs++;
+			tp->deadline += tp->period;
+			now = GhSchedNow();
+			if (tp->deadline <= now)
+			{
+				missed = (now - tp->deadline) / tp->period + 1;
+				tp->overruns += missed;
+				tp->deadline += missed * tp->period;
+			}
+		}
+		if (tp->deadline < next)
+		{
+			next = tp->deadline;
+		}
+	}
+	return next;
+}
+
+int GhSchedRun(sched_s * sch)
+{
+	struct epoll_event ev[GHSCHEDEVENTS];
+	uint64_t expirations;
+	int64_t next;
+	source_s * src;
+	int i, n;
+
+	if (sch->ntasks == 0)
+	{
+		return 0;
+	}
+	while (1)
+	{
+		next = GhSchedDispatch(sch);
+		if (GhSchedArm(sch, next) < 0)
+		{
+			return 0;
+		}
+		n = epoll_wait(sch->epfd, ev, GHSCHEDEVENTS, -1);
+		if (n < 0 && errno != EINTR)
+		{
+			return 0;
+		}
+		for (i = 0; i < n; i++)
+		{
+			if (ev[i].data.u64 == SRCSIGNAL)
+			{
+				return 1;
+			}
+			if (ev[i].data.u64 == SRCTIMER)
+			{
+				if (read(sch->tfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+				{
+					return 0;
+				}
+				continue;
+			}
+			src = &sch->sources[ev[i].data.u64];
+			// An earlier callback in this batch may have removed it
+			if (src->fd >= 0)
+			{
+				src->run(src->fd, ev[i].events, src->arg);
+			}
+		}
+	}
+}
+
+void GhSchedClose(sched_s * sch)
+{
+	if (sch->sfd > 0)
+	{
+		close(sch->sfd);
+	}
+	if (sch->tfd > 0)
+	{
+		close(sch->tfd);
+	}
+	if (sch->epfd > 0)
+	{
+		close(sch->epfd);
+	}
+	sch->sfd = -1;
+	sch->tfd = -1;
+	sch->epfd = -1;
+}
@@ -0,0 +1,69 @@
+/** @brief Gh periodic task scheduler constants, structures, function prototypes
+ *  @file ghsched.h
+ */
+
+#ifndef GHSCHED_H
+#define GHSCHED_H
+
+// Includes
+//
+#include <stdint.h>
+#include <time.h>
+
+// Constants
+
+#define GHMAXTASKS 16
+#define GHMAXSOURCES 128
+#define GHSCHEDEVENTS 16
+#define NSPERMS 1000000LL
+#define NSPERSEC 1000000000LL
+
+// Structures
+
+typedef void (*ghtask_fn)(void * arg);
+typedef void (*ghfd_fn)(int fd, uint32_t events, void * arg);
+
+typedef struct task
+{
+	const char * name;
+	int64_t period;
+	int64_t deadline;
+	ghtask_fn run;
+	void * arg;
+	unsigned long runs;
+	unsigned long overruns;
+}task_s;
+
+typedef struct source
+{
+	int fd;
+	ghfd_fn run;
+	void * arg;
+}source_s;
+
+typedef struct scheduler
+{
+	int epfd;
+	int tfd;
+	int sfd;
+	int ntasks;
+	int64_t epoch;
+	task_s tasks[GHMAXTASKS];
+	source_s sources[GHMAXSOURCES];
+}sched_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+int GhSchedInit(sched_s * sch);
+int GhSchedAddTask(sched_s * sch, const char * name, int period, ghtask_fn run, void * arg);
+int GhSchedSetPeriod(sched_s * sch, const char * name, int period);
+int GhSchedAddFd(sched_s * sch, int fd, uint32_t events, ghfd_fn run, void * arg);
+int GhSchedModFd(sched_s * sch, int fd, uint32_t events);
+void GhSchedDelFd(sched_s * sch, int fd);
+int GhSchedRun(sched_s * sch);
+void GhSchedClose(sched_s * sch);
+int64_t GhSchedNow(void);
+
+///@endcond
+#endif
@@ -0,0 +1,228 @@
+/** @brief Gh shared memory segment
+ *  @file ghshm.c
+ *  @details The controller publishes its live state and the recent readings
+ *           ring in a POSIX shared memory object (/dev/shm/ghcontrol).
+ *           The state is guarded by a seqlock: the writer makes seq odd,
+ *           copies the state and makes it even again. A reader copies the
+ *           state and keeps the copy only if seq was even and unchanged,
+ *           so it needs no syscall and never blocks the controller. The
+ *           ring uses its own per-slot sequence numbers (see ghring.c).
+ *           Readers map the segment read-only; only this file writes it.
+ */
+#include "ghshm.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** @brief The pid of a running controller that owns segment name, else 0.
+ *  @details Only the header is mapped, so a segment of another version
+ *           or size still shows whether its writer is alive.
+ */
+static pid_t GhShmLiveOwner(const char * name)
+{
+	const shmseg_s * seg;
+	struct stat st;
+	void * map;
+	pid_t pid = 0;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)offsetof(shmseg_s, state))
+	{
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, offsetof(shmseg_s, state), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		return 0;
+	}
+	seg = (const shmseg_s *)map;
+	if (memcmp(seg->magic, GHSHMMAGIC, sizeof(seg->magic)) == 0)
+	{
+		pid = __atomic_load_n(&seg->pid, __ATOMIC_RELAXED);
+	}
+	munmap(map, offsetof(shmseg_s, state));
+	if (pid <= 0 || pid == getpid() || (kill(pid, 0) < 0 && errno != EPERM))
+	{
+		return 0;
+	}
+	return pid;
+}
+
+/** @brief Creates a fresh segment, replacing one a crashed controller left.
+ *  @details Readers still attached to an old segment keep their mapping;
+ *           GhShmOwner() lets them notice it has no writer any more.
+ *           A segment whose controller is still running is left alone.
+ *  @return the mapped segment, or NULL on failure, with errno EBUSY if
+ *          another controller owns the segment
+ */
+shmseg_s * GhShmCreate(const char * name)
+{
+	shmseg_s * seg;
+	int fd;
+
+	if (GhShmLiveOwner(name) != 0)
+	{
+		errno = EBUSY;
+		return NULL;
+	}
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(shmseg_s)) < 0)
+	{
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	seg = (shmseg_s *)mmap(NULL, sizeof(shmseg_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg == MAP_FAILED)
+	{
+		shm_unlink(name);
+		return NULL;
+	}
+	// A new object is zero filled, so the ring is already empty
+	seg->version = GHSHMVERSION;
+	seg->size = sizeof(shmseg_s);
+	seg->pid = getpid();
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(seg->magic, GHSHMMAGIC, sizeof(seg->magic));
+	return seg;
+}
+
+void GhShmPublish(shmseg_s * seg, reading_s rd, control_s ctrl, setpoint_s sets, sensorstats_s stats)
+{
+	uint64_t seq;
+
+	seq = __atomic_load_n(&seg->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&seg->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	seg->state.rd = rd;
+	seg->state.ctrl = ctrl;
+	seg->state.sets = sets;
+	seg->state.stats = stats;
+	seg->state.updates++;
+	__atomic_store_n(&seg->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void GhShmDestroy(shmseg_s * seg, const char * name)
+{
+	if (seg == NULL)
+	{
+		return;
+	}
+	seg->pid = 0;
+	munmap(seg, sizeof(shmseg_s));
+	shm_unlink(name);
+}
+
+/** @brief Maps the controller's segment read-only.
+ *  @return 1 on success, 0 if there is no segment or it has another layout
+ */
+int GhShmAttach(shmview_s * sv, const char * name)
+{
+	const shmseg_s * seg;
+	struct stat st;
+	void * map;
+	int fd;
+
+	memset(sv, 0, sizeof(*sv));
+	fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size != (off_t)sizeof(shmseg_s))
+	{
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		return 0;
+	}
+	seg = (const shmseg_s *)map;
+	if (memcmp(seg->magic, GHSHMMAGIC, sizeof(seg->magic)) != 0)
+	{
+		munmap(map, st.st_size);
+		return 0;
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (seg->version != GHSHMVERSION || seg->size != sizeof(shmseg_s))
+	{
+		munmap(map, st.st_size);
+		return 0;
+	}
+	sv->seg = seg;
+	sv->mapsz = st.st_size;
+	return 1;
+}
+
+/** @brief Copies a consistent snapshot of the controller state.
+ *  @return 1 on success, 0 if nothing is published yet or the writer stayed
+ *          mid-update for GHSHMRETRIES attempts (it died there)
+ */
+int GhShmState(const shmview_s * sv, shmstate_s * st)
+{
+	uint64_t seq;
+	int i;
+
+	for (i = 0; i < GHSHMRETRIES; i++)
+	{
+		seq = __atomic_load_n(&sv->seg->seq, __ATOMIC_ACQUIRE);
+		if (seq == 0)
+		{
+			return 0;
+		}
+		if (seq & 1)
+		{
+			continue;
+		}
+		memcpy(st, (const void *)&sv->seg->state, sizeof(*st));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&sv->seg->seq, __ATOMIC_RELAXED) == seq)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/** @brief Copies up to max of the most recent readings, oldest first.
+ */
+size_t GhShmRecent(const shmview_s * sv, reading_s * out, size_t max)
+{
+	return GhRingRecent(&sv->seg->ring, out, max);
+}
+
+/** @brief The controller writing the segment, 0 once it has shut down.
+ */
+pid_t GhShmOwner(const shmview_s * sv)
+{
+	return __atomic_load_n(&sv->seg->pid, __ATOMIC_RELAXED);
+}
+
+void GhShmDetach(shmview_s * sv)
+{
+	if (sv->seg != NULL)
+	{
+		munmap((void *)sv->seg, sv->mapsz);
+	}
+	memset(sv, 0, sizeof(*sv));
+}
@@ -0,0 +1,65 @@
+/** @brief Gh shared memory segment constants, structures, function prototypes
+ *  @file ghshm.h
+ */
+
+#ifndef GHSHM_H
+#define GHSHM_H
+
+// Includes
+//
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "ghcontrol.h"
+#include "ghring.h"
+
+// Constants
+
+#define GHSHMNAME "/ghcontrol"
+#define GHSHMMAGIC "GHSM"
+#define GHSHMVERSION 1
+#define GHSHMRETRIES 1000
+
+// Structures
+
+typedef struct shmstate
+{
+	reading_s rd;
+	control_s ctrl;
+	setpoint_s sets;
+	sensorstats_s stats;
+	uint64_t updates;
+}shmstate_s;
+
+typedef struct shmseg
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t reserved;
+	uint32_t size;
+	int32_t pid;
+	uint64_t seq;
+	shmstate_s state;
+	ring_s ring;
+}shmseg_s;
+
+typedef struct shmview
+{
+	const shmseg_s * seg;
+	size_t mapsz;
+}shmview_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+shmseg_s * GhShmCreate(const char * name);
+void GhShmPublish(shmseg_s * seg, reading_s rd, control_s ctrl, setpoint_s sets, sensorstats_s stats);
+void GhShmDestroy(shmseg_s * seg, const char * name);
+int GhShmAttach(shmview_s * sv, const char * name);
+int GhShmState(const shmview_s * sv, shmstate_s * st);
+size_t GhShmRecent(const shmview_s * sv, reading_s * out, size_t max);
+pid_t GhShmOwner(const shmview_s * sv);
+void GhShmDetach(shmview_s * sv);
+
+///@endcond
+#endif
@@ -0,0 +1,148 @@
+/** @brief ghshm: inspects the controller's shared memory segment
+ *  @file ghshmtool.c
+ *  @details ghshm            prints the live state once
+ *           ghshm -f         prints it again at every update
+ *           ghshm -r count   prints the most recent readings as CSV
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include "ghshm.h"
+
+#define GHSHMPOLL 100
+
+// Local so the tool links with ghshm.o and ghring.o alone
+static int64_t GhShmMonoNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * GHNSPERSEC + ts.tv_nsec;
+}
+
+static void GhShmFormatTime(char * buf, size_t bufsz, int64_t ntime)
+{
+	struct tm tm;
+	time_t sec;
+	size_t len;
+
+	sec = (time_t)(ntime / GHNSPERSEC);
+	localtime_r(&sec, &tm);
+	len = strftime(buf, bufsz, "%Y-%m-%d %H:%M:%S", &tm);
+	snprintf(buf + len, bufsz - len, ".%03d", (int)(ntime % GHNSPERSEC / 1000000));
+}
+
+static void GhShmPrintState(const shmview_s * sv, const shmstate_s * st)
+{
+	char tbuf[CTIMESTRSZ + 8];
+	pid_t pid;
+
+	pid = GhShmOwner(sv);
+	GhShmFormatTime(tbuf, sizeof(tbuf), st->rd.ntime);
+	fprintf(stdout, "Owner\t\tPid: %d\t%s\tUpdates: %llu\n", (int)pid,
+			pid == 0 ? "stopped" : kill(pid, 0) == 0 || errno == EPERM ? "running" : "gone",
+			(unsigned long long)st->updates);
+	fprintf(stdout, "Readings\t%s\tAge: %.1fms", tbuf, (GhShmMonoNow() - st->rd.mtime) / 1e6);
+	if (st->rd.sampled != 0)
+	{
+		fprintf(stdout, "\tSampled: %.1fms ago", (GhShmMonoNow() - st->rd.sampled) / 1e6);
+	}
+	fprintf(stdout, "\n");
+	fprintf(stdout, "\t\tT: %5.1fC\tH: %5.1f%%\tP: %6.1fmB\tStale: %d\n",
+			st->rd.temperature, st->rd.humidity, st->rd.pressure, st->rd.stale);
+	fprintf(stdout, "Setpoints\tT: %5.1fC\tH: %5.1f%%\n", st->sets.temperature, st->sets.humidity);
+	fprintf(stdout, "Controls\tHeater: %d\tHumidifier: %d\n", st->ctrl.heater, st->ctrl.humidifier);
+	fprintf(stdout, "Sensors\t\tSamples: %llu\tNaNs: %llu\tRetries: %llu\tTimeouts: %llu\tStalls: %llu\tDropped: %llu\n",
+			(unsigned long long)st->stats.samples, (unsigned long long)st->stats.nans,
+			(unsigned long long)st->stats.retries, (unsigned long long)st->stats.timeouts,
+			(unsigned long long)st->stats.stalls, (unsigned long long)st->stats.dropped);
+}
+
+static int GhShmPrintRecent(const shmview_s * sv, size_t count)
+{
+	char tbuf[CTIMESTRSZ + 8];
+	reading_s * rd;
+	size_t i, n;
+
+	if (count > GHRINGSIZE)
+	{
+		count = GHRINGSIZE;
+	}
+	rd = (reading_s *)malloc(count * sizeof(reading_s));
+	if (rd == NULL)
+	{
+		return 0;
+	}
+	n = GhShmRecent(sv, rd, count);
+	for (i = 0; i < n; i++)
+	{
+		GhShmFormatTime(tbuf, sizeof(tbuf), rd[i].ntime);
+		fprintf(stdout, "%s,%.1f,%.1f,%.1f\n", tbuf, rd[i].temperature, rd[i].humidity, rd[i].pressure);
+	}
+	free(rd);
+	return 1;
+}
+
+int main(int argc, char * argv[])
+{
+	shmview_s sv;
+	shmstate_s st;
+	uint64_t seen = 0;
+	int opt, follow = 0;
+	long recent = 0;
+
+	while ((opt = getopt(argc, argv, "fr:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'f':
+				follow = 1;
+				break;
+			case 'r':
+				recent = strtol(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-f] [-r count]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (!GhShmAttach(&sv, GHSHMNAME))
+	{
+		fprintf(stderr, "No controller segment %s\n", GHSHMNAME);
+		return EXIT_FAILURE;
+	}
+	if (recent > 0)
+	{
+		GhShmPrintRecent(&sv, recent);
+		GhShmDetach(&sv);
+		return EXIT_SUCCESS;
+	}
+	do
+	{
+		if (GhShmState(&sv, &st) && st.updates != seen)
+		{
+			if (seen != 0)
+			{
+				fprintf(stdout, "\n");
+			}
+			GhShmPrintState(&sv, &st);
+			fflush(stdout);
+			seen = st.updates;
+		}
+		else if (!follow)
+		{
+			fprintf(stderr, "Nothing published yet\n");
+			GhShmDetach(&sv);
+			return EXIT_FAILURE;
+		}
+		if (follow)
+		{
+			usleep(GHSHMPOLL * 1000);
+		}
+	}
+	while (follow);
+	GhShmDetach(&sv);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,426 @@
+/** @brief Gh sharded station store
+ *  @file ghstation.c
+ *  @details Keeps recent readings for many stations and per-zone aggregates
+ *           for a site collector. Stations are spread over shards by a hash
+ *           of their id; each shard has one worker thread that owns its
+ *           stations outright, so applying a record takes no lock.
+ *
+ *           One receiving thread feeds the shards through single-producer/
+ *           single-consumer queues and a full queue drops the record.
+ *           Readers never block a worker either:
+ *             - a shard's table is open addressing that only ever grows, and
+ *               a key is published after its station is set up;
+ *             - each station's history is a small ring whose slots carry a
+ *               sequence number, as in ghring.c;
+ *             - every GHSTATIONAGG ms a worker summarises the latest reading
+ *               of its stations per zone and publishes that under a seqlock.
+ *           A site-wide query merges one summary per shard.
+ */
+#include "ghstation.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+static int64_t GhStationNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * GHNSPERSEC + ts.tv_nsec;
+}
+
+static void GhStationSleep(int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+	{
+	}
+}
+
+/** @brief splitmix64 finaliser; serial numbers are far from uniform.
+ */
+static uint64_t GhStationMix(uint64_t id)
+{
+	id ^= id >> 30;
+	id *= 0xBF58476D1CE4E5B9ull;
+	id ^= id >> 27;
+	id *= 0x94D049BB133111EBull;
+	return id ^ (id >> 31);
+}
+
+/** @brief Looks up id in a shard, or adds it if insert is set.
+ *  @details Keys hold id + 1 so that 0 marks a free slot. Only the shard's
+ *           worker inserts.
+ *  @return the station, or NULL if it is absent (or the shard is full)
+ */
+static station_s * GhStationLookup(stationshard_s * sh, uint64_t id, uint64_t mix, int insert)
+{
+	uint64_t i, key;
+	station_s * st;
+
+	for (i = (mix >> 32) & (sh->cap - 1);; i = (i + 1) & (sh->cap - 1))
+	{
+		key = __atomic_load_n(&sh->keys[i], __ATOMIC_ACQUIRE);
+		if (key == id + 1)
+		{
+			return &sh->stations[i];
+		}
+		if (key == 0)
+		{
+			break;
+		}
+	}
+	if (!insert || sh->nstations >= sh->maxfill)
+	{
+		return NULL;
+	}
+	st = &sh->stations[i];
+	st->id = id;
+	__atomic_store_n(&sh->keys[i], id + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&sh->nstations, sh->nstations + 1, __ATOMIC_RELAXED);
+	return st;
+}
+
+static void GhStationApply(stationshard_s * sh, const mcastrecord_s * rec, int64_t now)
+{
+	stationslot_s * sp;
+	station_s * st;
+	uint64_t idx;
+	uint32_t gap;
+
+	st = GhStationLookup(sh, rec->station, GhStationMix(rec->station), 1);
+	if (st == NULL)
+	{
+		__atomic_store_n(&sh->full, sh->full + 1, __ATOMIC_RELAXED);
+		return;
+	}
+	idx = st->head;
+	if (idx > 0)
+	{
+		// A long jump back or forward is a restarted controller, not loss
+		gap = rec->seq - st->slot[(idx - 1) % GHSTATIONHIST].s.seq - 1;
+		if (gap > 0 && gap < GHSTATIONLOSTMAX)
+		{
+			__atomic_store_n(&st->lost, st->lost + gap, __ATOMIC_RELAXED);
+			__atomic_store_n(&sh->lost, sh->lost + gap, __ATOMIC_RELAXED);
+		}
+	}
+	sp = &st->slot[idx % GHSTATIONHIST];
+	__atomic_store_n(&sp->seq, 2 * idx + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	sp->s.ntime = rec->ntime;
+	sp->s.seq = rec->seq;
+	sp->s.temperature = rec->temperature;
+	sp->s.humidity = rec->humidity;
+	sp->s.pressure = rec->pressure;
+	sp->s.stale = rec->stale;
+	sp->s.controls = rec->controls;
+	__atomic_store_n(&sp->seq, 2 * idx + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&st->head, idx + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&st->zone, rec->zone, __ATOMIC_RELAXED);
+	__atomic_store_n(&st->heard, now, __ATOMIC_RELAXED);
+	__atomic_store_n(&st->records, st->records + 1, __ATOMIC_RELAXED);
+}
+
+static void GhStationAdd(zoneagg_s * za, int sensor, float v)
+{
+	if (za->count[sensor] == 0 || v < za->min[sensor])
+	{
+		za->min[sensor] = v;
+	}
+	if (za->count[sensor] == 0 || v > za->max[sensor])
+	{
+		za->max[sensor] = v;
+	}
+	za->sum[sensor] += v;
+	za->count[sensor]++;
+}
+
+/** @brief Summarises the latest reading of every station in the shard.
+ */
+static void GhStationAggregate(stationshard_s * sh, int64_t now)
+{
+	const stationsample_s * sp;
+	const station_s * st;
+	zoneagg_s * za;
+	uint64_t i, seq;
+
+	memset(sh->work, 0, sizeof(sh->work));
+	for (i = 0; i < sh->cap; i++)
+	{
+		if (sh->keys[i] == 0)
+		{
+			continue;
+		}
+		st = &sh->stations[i];
+		za = &sh->work[st->zone];
+		za->stations++;
+		if (now - st->heard > GHSTATIONSILENT * GHNSPERSEC)
+		{
+			za->silent++;
+			continue;
+		}
+		sp = &st->slot[(st->head - 1) % GHSTATIONHIST].s;
+		if (!(sp->stale & (1 << TEMPERATURE)) && !isnan(sp->temperature))
+		{
+			GhStationAdd(za, TEMPERATURE, sp->temperature);
+		}
+		if (!(sp->stale & (1 << HUMIDITY)) && !isnan(sp->humidity))
+		{
+			GhStationAdd(za, HUMIDITY, sp->humidity);
+		}
+		if (!(sp->stale & (1 << PRESSURE)) && !isnan(sp->pressure))
+		{
+			GhStationAdd(za, PRESSURE, sp->pressure);
+		}
+	}
+	seq = __atomic_load_n(&sh->aggseq, __ATOMIC_RELAXED);
+	__atomic_store_n(&sh->aggseq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(sh->agg, sh->work, sizeof(sh->agg));
+	__atomic_store_n(&sh->aggseq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void * GhStationThread(void * arg)
+{
+	stationshard_s * sh = (stationshard_s *)arg;
+	uint64_t head, tail;
+	int64_t now, next;
+	int n;
+
+	next = GhStationNow();
+	tail = sh->tail;
+	while (!__atomic_load_n(&sh->ss->stop, __ATOMIC_ACQUIRE))
+	{
+		now = GhStationNow();
+		head = __atomic_load_n(&sh->head, __ATOMIC_ACQUIRE);
+		for (n = 0; tail != head && n < GHSTATIONBATCH; n++, tail++)
+		{
+			GhStationApply(sh, &sh->queue[tail % GHSTATIONQUEUE], now);
+		}
+		__atomic_store_n(&sh->tail, tail, __ATOMIC_RELEASE);
+		__atomic_store_n(&sh->processed, sh->processed + n, __ATOMIC_RELAXED);
+		if (now >= next)
+		{
+			GhStationAggregate(sh, now);
+			next = now + GHSTATIONAGG * (GHNSPERSEC / 1000);
+		}
+		if (n == 0)
+		{
+			GhStationSleep(GHSTATIONIDLE);
+		}
+	}
+	return NULL;
+}
+
+/** @brief Allocates nshards shards and starts one worker per shard.
+ *  @details Each shard's table is sized for twice its share of the expected
+ *           stations, so it stays under 3/4 full with room for an uneven
+ *           hash; the size doesn't depend on how many shards there are.
+ *           Tables are calloc()ed; pages are only backed by memory once
+ *           stations land on them.
+ *  @return 1 on success, 0 on failure
+ */
+int GhStationStart(stationstore_s * ss, int nshards, uint64_t expected)
+{
+	stationshard_s * sh;
+	uint64_t cap;
+	int i;
+
+	memset(ss, 0, sizeof(*ss));
+	if (nshards < 1 || nshards > GHSTATIONMAXSHARDS)
+	{
+		return 0;
+	}
+	for (cap = GHSTATIONMINCAP; cap < GHSTATIONMAXCAP && cap < 2 * ((expected + nshards - 1) / nshards); cap *= 2)
+	{
+	}
+	ss->nshards = nshards;
+	for (i = 0; i < nshards; i++)
+	{
+		sh = &ss->shard[i];
+		sh->ss = ss;
+		sh->cap = cap;
+		sh->maxfill = cap / 4 * 3;
+		sh->queue = (mcastrecord_s *)calloc(GHSTATIONQUEUE, sizeof(mcastrecord_s));
+		sh->keys = (uint64_t *)calloc(cap, sizeof(uint64_t));
+		sh->stations = (station_s *)calloc(cap, sizeof(station_s));
+		if (sh->queue == NULL || sh->keys == NULL || sh->stations == NULL
+				|| pthread_create(&sh->thread, NULL, GhStationThread, sh) != 0)
+		{
+			ss->nshards = i + 1;
+			GhStationStop(ss);
+			return 0;
+		}
+		ss->running = i + 1;
+	}
+	return 1;
+}
+
+void GhStationStop(stationstore_s * ss)
+{
+	stationshard_s * sh;
+	int i;
+
+	__atomic_store_n(&ss->stop, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < ss->nshards; i++)
+	{
+		sh = &ss->shard[i];
+		if (i < ss->running)
+		{
+			pthread_join(sh->thread, NULL);
+		}
+		free(sh->queue);
+		free(sh->keys);
+		free(sh->stations);
+		sh->queue = NULL;
+		sh->keys = NULL;
+		sh->stations = NULL;
+	}
+	ss->running = 0;
+	ss->nshards = 0;
+}
+
+/** @brief Hands a record to its station's shard. Call from one thread only.
+ *  @return 1 if queued, 0 if the shard's queue was full and it was dropped
+ */
+int GhStationPut(stationstore_s * ss, const mcastrecord_s * rec)
+{
+	stationshard_s * sh;
+	uint64_t head, tail;
+
+	sh = &ss->shard[GhStationMix(rec->station) % ss->nshards];
+	head = sh->head;
+	tail = __atomic_load_n(&sh->tail, __ATOMIC_ACQUIRE);
+	if (head - tail >= GHSTATIONQUEUE)
+	{
+		__atomic_store_n(&sh->dropped, sh->dropped + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	sh->queue[head % GHSTATIONQUEUE] = *rec;
+	__atomic_store_n(&sh->head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/** @return the station with this id, or NULL if it was never heard
+ */
+const station_s * GhStationFind(const stationstore_s * ss, uint64_t id)
+{
+	uint64_t mix;
+
+	mix = GhStationMix(id);
+	return GhStationLookup((stationshard_s *)&ss->shard[mix % ss->nshards], id, mix, 0);
+}
+
+/** @brief Copies up to max of a station's most recent samples, oldest first.
+ *  @return the number of samples copied
+ */
+size_t GhStationRecent(const station_s * st, stationsample_s * out, size_t max)
+{
+	const stationslot_s * sp;
+	uint64_t head, idx, seq;
+	size_t n = 0;
+
+	head = __atomic_load_n(&st->head, __ATOMIC_ACQUIRE);
+	if (max > GHSTATIONHIST)
+	{
+		max = GHSTATIONHIST;
+	}
+	for (idx = head > max ? head - max : 0; idx < head; idx++)
+	{
+		sp = &st->slot[idx % GHSTATIONHIST];
+		seq = __atomic_load_n(&sp->seq, __ATOMIC_ACQUIRE);
+		if (seq != 2 * idx + 2)
+		{
+			continue;
+		}
+		memcpy(&out[n], (const void *)&sp->s, sizeof(out[n]));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&sp->seq, __ATOMIC_RELAXED) == seq)
+		{
+			n++;
+		}
+	}
+	return n;
+}
+
+/** @brief Site-wide per-zone aggregates, merged from every shard's summary.
+ *  @param out GHSTATIONZONES entries; zones with no stations are zeroed
+ */
+void GhStationZones(const stationstore_s * ss, zoneagg_s * out)
+{
+	zoneagg_s part[GHSTATIONZONES];
+	const stationshard_s * sh;
+	zoneagg_s * za;
+	uint64_t seq;
+	int i, z, k, tries;
+
+	memset(out, 0, GHSTATIONZONES * sizeof(zoneagg_s));
+	for (i = 0; i < ss->nshards; i++)
+	{
+		sh = &ss->shard[i];
+		for (tries = 0; tries < GHSTATIONRETRIES; tries++)
+		{
+			seq = __atomic_load_n(&sh->aggseq, __ATOMIC_ACQUIRE);
+			if (seq & 1)
+			{
+				continue;
+			}
+			memcpy(part, (const void *)sh->agg, sizeof(part));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&sh->aggseq, __ATOMIC_RELAXED) == seq)
+			{
+				break;
+			}
+		}
+		if (tries == GHSTATIONRETRIES)
+		{
+			continue;
+		}
+		for (z = 0; z < GHSTATIONZONES; z++)
+		{
+			za = &out[z];
+			za->stations += part[z].stations;
+			za->silent += part[z].silent;
+			for (k = 0; k < SENSORS; k++)
+			{
+				if (part[z].count[k] == 0)
+				{
+					continue;
+				}
+				if (za->count[k] == 0 || part[z].min[k] < za->min[k])
+				{
+					za->min[k] = part[z].min[k];
+				}
+				if (za->count[k] == 0 || part[z].max[k] > za->max[k])
+				{
+					za->max[k] = part[z].max[k];
+				}
+				za->sum[k] += part[z].sum[k];
+				za->count[k] += part[z].count[k];
+			}
+		}
+	}
+}
+
+void GhStationTotals(const stationstore_s * ss, stationtotals_s * tot)
+{
+	const stationshard_s * sh;
+	int i;
+
+	memset(tot, 0, sizeof(*tot));
+	for (i = 0; i < ss->nshards; i++)
+	{
+		sh = &ss->shard[i];
+		tot->stations += __atomic_load_n(&sh->nstations, __ATOMIC_RELAXED);
+		tot->processed += __atomic_load_n(&sh->processed, __ATOMIC_RELAXED);
+		tot->dropped += __atomic_load_n(&sh->dropped, __ATOMIC_RELAXED);
+		tot->lost += __atomic_load_n(&sh->lost, __ATOMIC_RELAXED);
+		tot->full += __atomic_load_n(&sh->full, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,126 @@
+/** @brief Gh sharded station store constants, structures, function prototypes
+ *  @file ghstation.h
+ */
+
+#ifndef GHSTATION_H
+#define GHSTATION_H
+
+// Includes
+//
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "ghcontrol.h"
+#include "ghmcast.h"
+
+// Constants
+
+#define GHSTATIONSHARDS 4
+#define GHSTATIONMAXSHARDS 16
+#define GHSTATIONEXPECT 10000
+#define GHSTATIONMINCAP 1024
+#define GHSTATIONMAXCAP (1 << 22)
+#define GHSTATIONHIST 64
+#define GHSTATIONZONES GHMCASTZONES
+#define GHSTATIONQUEUE 16384
+#define GHSTATIONBATCH 256
+#define GHSTATIONAGG 1000
+#define GHSTATIONSILENT 60
+#define GHSTATIONIDLE 1
+#define GHSTATIONLOSTMAX 1000
+#define GHSTATIONRETRIES 1000
+
+// Structures
+
+typedef struct stationsample
+{
+	int64_t ntime;
+	uint32_t seq;
+	float temperature;
+	float humidity;
+	float pressure;
+	uint8_t stale;
+	uint8_t controls;
+}stationsample_s;
+
+typedef struct stationslot
+{
+	uint64_t seq;
+	stationsample_s s;
+}stationslot_s;
+
+typedef struct station
+{
+	uint64_t id;
+	int zone;
+	int64_t heard;
+	uint64_t records;
+	uint64_t lost;
+	uint64_t head;
+	stationslot_s slot[GHSTATIONHIST];
+}station_s;
+
+typedef struct zoneagg
+{
+	uint32_t stations;
+	uint32_t silent;
+	uint32_t count[SENSORS];
+	float min[SENSORS];
+	float max[SENSORS];
+	double sum[SENSORS];
+}zoneagg_s;
+
+typedef struct stationtotals
+{
+	uint64_t stations;
+	uint64_t processed;
+	uint64_t dropped;
+	uint64_t lost;
+	uint64_t full;
+}stationtotals_s;
+
+struct stationstore;
+
+typedef struct stationshard
+{
+	pthread_t thread;
+	struct stationstore * ss;
+	// Producer and consumer ends sit on their own cache lines
+	uint64_t head __attribute__((aligned(64)));
+	uint64_t dropped;
+	uint64_t tail __attribute__((aligned(64)));
+	uint64_t processed;
+	uint64_t lost;
+	uint64_t full;
+	uint64_t nstations;
+	uint64_t cap;
+	uint64_t maxfill;
+	mcastrecord_s * queue;
+	uint64_t * keys;
+	station_s * stations;
+	uint64_t aggseq;
+	zoneagg_s agg[GHSTATIONZONES];
+	zoneagg_s work[GHSTATIONZONES];
+}stationshard_s;
+
+typedef struct stationstore
+{
+	int nshards;
+	int running;
+	int stop;
+	stationshard_s shard[GHSTATIONMAXSHARDS];
+}stationstore_s;
+
+///@cond INTERNAL
+// Function prototypes
+
+int GhStationStart(stationstore_s * ss, int nshards, uint64_t expected);
+void GhStationStop(stationstore_s * ss);
+int GhStationPut(stationstore_s * ss, const mcastrecord_s * rec);
+const station_s * GhStationFind(const stationstore_s * ss, uint64_t id);
+size_t GhStationRecent(const station_s * st, stationsample_s * out, size_t max);
+void GhStationZones(const stationstore_s * ss, zoneagg_s * out);
+void GhStationTotals(const stationstore_s * ss, stationtotals_s * tot);
+
+///@endcond
+#endif
@@ -0,0 +1,100 @@
+/**
+ * @file hts221.cpp
+ * @details The chip averages AVGH/AVGT conversions per output sample. Each
+ *          part carries two factory calibration points per quantity; they
+ *          are read once in Init() and readings are interpolated between
+ *          them.
+ */
+#include "hts221.h"
+
+/**
+ * @brief Hts221::Hts221
+ * @param bus the transport, shared with the other sensors on the HAT
+ */
+Hts221::Hts221(I2cBus &bus, uint8_t address) : bus(bus), address(address)
+{
+    valid = false;
+    lastHumidity = 0;
+    lastTemperature = 0;
+    h0 = h1 = h0Out = h1Out = 0;
+    t0 = t1 = t0Out = t1Out = 0;
+}
+
+/**
+ * @brief Hts221::Init
+ * @param odr one of HTS221_ODR_*
+ * @param avConf AVGT | AVGH averaging
+ * @return false if the chip does not answer as an HTS221
+ */
+bool Hts221::Init(uint8_t odr, uint8_t avConf)
+{
+    uint8_t id;
+    uint8_t c[HTS221_CALIB_SZ];
+
+    if (!bus.Read(address, HTS221_WHO_AM_I, &id, 1) || id != HTS221_ID)
+    {
+        return false;
+    }
+    if (!bus.Read(address, HTS221_CALIB | I2C_AUTO_INCREMENT, c, sizeof(c)))
+    {
+        return false;
+    }
+    h0 = c[0x00] / 2.0f;
+    h1 = c[0x01] / 2.0f;
+    t0 = ((c[0x05] & 0x03) << 8 | c[0x02]) / 8.0f;
+    t1 = ((c[0x05] & 0x0C) << 6 | c[0x03]) / 8.0f;
+    h0Out = (int16_t)(c[0x07] << 8 | c[0x06]);
+    h1Out = (int16_t)(c[0x0B] << 8 | c[0x0A]);
+    t0Out = (int16_t)(c[0x0D] << 8 | c[0x0C]);
+    t1Out = (int16_t)(c[0x0F] << 8 | c[0x0E]);
+    if (h1Out == h0Out || t1Out == t0Out)
+    {
+        return false;
+    }
+    valid = false;
+    return bus.Write(address, HTS221_CTRL_REG1, 0)
+        && bus.Write(address, HTS221_AV_CONF, avConf)
+        && bus.Write(address, HTS221_CTRL_REG1, HTS221_PD | HTS221_BDU | odr);
+}
+
+/**
+ * @brief Hts221::Read
+ * @details One burst of the status and both outputs. Returns the previous
+ *          values when no conversion finished since the last read.
+ * @return false until the first conversion, or on a bus error
+ */
+bool Hts221::Read(float &humidity, float &temperature)
+{
+    uint8_t buf[5];
+    int16_t h, t;
+    float rh;
+
+    if (!bus.Read(address, HTS221_STATUS_REG | I2C_AUTO_INCREMENT, buf, sizeof(buf)))
+    {
+        return false;
+    }
+    if ((buf[0] & (HTS221_H_DA | HTS221_T_DA)) == (HTS221_H_DA | HTS221_T_DA))
+    {
+        h = (int16_t)(buf[2] << 8 | buf[1]);
+        t = (int16_t)(buf[4] << 8 | buf[3]);
+        rh = h0 + (h - h0Out) * (h1 - h0) / (h1Out - h0Out);
+        if (rh < 0)
+        {
+            rh = 0;
+        }
+        if (rh > 100)
+        {
+            rh = 100;
+        }
+        lastHumidity = rh;
+        lastTemperature = t0 + (t - t0Out) * (t1 - t0) / (t1Out - t0Out);
+        valid = true;
+    }
+    if (!valid)
+    {
+        return false;
+    }
+    humidity = lastHumidity;
+    temperature = lastTemperature;
+    return true;
+}
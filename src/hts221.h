@@ -0,0 +1,51 @@
+/**
+ * @file hts221.h
+ * @details HTS221 relative humidity and temperature sensor driver.
+ */
+#ifndef HTS221_H
+#define HTS221_H
+
+#include "i2cbus.h"
+
+#define HTS221_ADDRESS 0x5F
+#define HTS221_ID 0xBC
+
+#define HTS221_WHO_AM_I 0x0F
+#define HTS221_AV_CONF 0x10
+#define HTS221_CTRL_REG1 0x20
+#define HTS221_STATUS_REG 0x27
+#define HTS221_HUMIDITY_OUT_L 0x28
+#define HTS221_CALIB 0x30
+#define HTS221_CALIB_SZ 16
+
+#define HTS221_PD 0x80
+#define HTS221_BDU 0x04
+#define HTS221_ODR_1HZ 0x01
+#define HTS221_ODR_7HZ 0x02
+#define HTS221_ODR_12HZ5 0x03
+#define HTS221_H_DA 0x02
+#define HTS221_T_DA 0x01
+
+// AV_CONF: AVGT[5:3] 2..256 samples, AVGH[2:0] 4..512 samples
+#define HTS221_AVGT_16 0x18
+#define HTS221_AVGH_32 0x03
+#define HTS221_AVGH_64 0x04
+
+class Hts221
+{
+public:
+    Hts221(I2cBus &bus, uint8_t address = HTS221_ADDRESS);
+    bool Init(uint8_t odr, uint8_t avConf);
+    bool Read(float &humidity, float &temperature);
+
+private:
+    I2cBus &bus;
+    uint8_t address;
+    bool valid;
+    float lastHumidity;
+    float lastTemperature;
+    float h0, h1, h0Out, h1Out;
+    float t0, t1, t0Out, t1Out;
+};
+
+#endif // HTS221_H
@@ -0,0 +1,255 @@
+/** @brief Gh HTTP server loopback test
+ *  @file httptest.c
+ *  @details httptest: serves a temporary history on a loopback port from
+ *           the scheduler loop while a client thread requests /readings,
+ *           /history with good and bad ranges and /events, then stops the
+ *           loop with SIGTERM. Prints each failed check and exits non-zero
+ *           if there was one.
+ */
+#include "ghhttp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define CHECK(cond) Check((cond), #cond, __LINE__)
+
+#define TESTROWS 100
+#define TESTSTART 1000LL
+#define TESTPUBLISH 50
+#define TESTTIMEOUT 2
+#define TESTRESPSZ 65536
+
+static int failures;
+static int port;
+static reading_s rd;
+static setpoint_s sets = {25, 55};
+static control_s ctrl = {1, 0};
+static ring_s ring;
+static httpserver_s srv;
+
+static void Check(int ok, const char * what, int line)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "httptest.c:%d: %s\n", line, what);
+		failures++;
+	}
+}
+
+/** @brief Counts the occurrences of what in s.
+ */
+static int Count(const char * s, const char * what)
+{
+	int n;
+
+	for (n = 0; (s = strstr(s, what)) != NULL; n++, s++)
+	{
+	}
+	return n;
+}
+
+/** @brief Connects to the server and sends one request.
+ *  @return the socket, or -1
+ */
+static int Request(const char * target)
+{
+	struct sockaddr_in sin;
+	struct timeval tv = {TESTTIMEOUT, 0};
+	char req[256];
+	int fd, len;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n", target);
+	if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 || send(fd, req, len, MSG_NOSIGNAL) != len)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/** @brief Reads until the server closes, the timeout passes or until is seen
+ *         count times.
+ *  @return the status code, or -1
+ */
+static int Response(int fd, char * buf, size_t bufsz, const char * until, int count)
+{
+	size_t len = 0;
+	ssize_t n;
+	int status;
+
+	buf[0] = 0;
+	while (len < bufsz - 1 && (until == NULL || Count(buf, until) < count))
+	{
+		n = recv(fd, buf + len, bufsz - 1 - len, 0);
+		if (n <= 0)
+		{
+			break;
+		}
+		len += n;
+		buf[len] = 0;
+	}
+	close(fd);
+	if (sscanf(buf, "HTTP/1.1 %d", &status) != 1)
+	{
+		return -1;
+	}
+	return status;
+}
+
+static int Get(const char * target, char * buf, size_t bufsz)
+{
+	int fd;
+
+	fd = Request(target);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	return Response(fd, buf, bufsz, NULL, 0);
+}
+
+static void * Client(void * arg)
+{
+	static char buf[TESTRESPSZ];
+	int fd;
+
+	CHECK(Get("/readings", buf, sizeof(buf)) == 200);
+	CHECK(strstr(buf, "Content-Type: application/json\r\n") != NULL);
+	CHECK(strstr(buf, "\"temperature\":") != NULL);
+#ifndef GHHTTPORIGIN
+	CHECK(strstr(buf, "Access-Control-Allow-Origin") == NULL);
+#endif
+
+	CHECK(Get("/controls", buf, sizeof(buf)) == 200);
+	CHECK(strstr(buf, "{\"heater\":1,\"humidifier\":0,") != NULL);
+
+	// Ten rows from the columns; all of it takes in the ring's unflushed tail
+	CHECK(Get("/history?from=1000000&to=1010000", buf, sizeof(buf)) == 200);
+	CHECK(Count(buf, "\"time\":") == 10);
+	CHECK(strstr(buf, "{\"time\":1000000,") != NULL);
+	CHECK(strstr(buf, "{\"time\":1009000,") != NULL);
+	CHECK(Get("/history", buf, sizeof(buf)) == 200);
+	CHECK(Count(buf, "\"time\":") == TESTROWS);
+	CHECK(Get("/history?from=1000000&to=1010000&max=3", buf, sizeof(buf)) == 200);
+	CHECK(Count(buf, "\"time\":") == 3);
+	CHECK(Get("/history?from=2000000&to=3000000", buf, sizeof(buf)) == 200);
+	CHECK(Count(buf, "\"time\":") == 0);
+
+	// Bad ranges
+	CHECK(Get("/history?from=abc&to=1010000", buf, sizeof(buf)) == 400);
+	CHECK(Get("/history?from=1000000&to=", buf, sizeof(buf)) == 400);
+	CHECK(Get("/history?from=1010000&to=1000000", buf, sizeof(buf)) == 400);
+	CHECK(Get("/history?from=99999999999999999999", buf, sizeof(buf)) == 400);
+
+	CHECK(Get("/nothing", buf, sizeof(buf)) == 404);
+
+	// The current reading at once, then the published ones
+	fd = Request("/events");
+	CHECK(fd >= 0);
+	if (fd >= 0)
+	{
+		CHECK(Response(fd, buf, sizeof(buf), "data: ", 3) == 200);
+		CHECK(strstr(buf, "Content-Type: text/event-stream\r\n") != NULL);
+		CHECK(Count(buf, "data: {\"time\":") == 3);
+	}
+
+	kill(getpid(), SIGTERM);
+	return arg;
+}
+
+/** @brief Sends a new reading to the subscribers every TESTPUBLISH ms.
+ */
+static void Publish(void * arg)
+{
+	rd.ntime += GHNSPERSEC;
+	rd.temperature += 1.0f;
+	GhHttpPublish(&srv, rd);
+}
+
+int main(void)
+{
+	char tmpl[] = "/tmp/httptestXXXXXX";
+	char logname[64], cmd[64];
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	histwriter_s hw;
+	sched_s sch;
+	pthread_t client;
+	int i;
+
+	if (mkdtemp(tmpl) == NULL)
+	{
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	snprintf(logname, sizeof(logname), "%s/ghdata.txt", tmpl);
+	GhRingInit(&ring);
+	CHECK(GhHistOpen(&hw, logname));
+	for (i = 0; i < TESTROWS; i++)
+	{
+		memset(&rd, 0, sizeof(rd));
+		rd.ntime = (TESTSTART + i) * GHNSPERSEC;
+		rd.temperature = 20.0f + i % 10;
+		rd.humidity = 50.0f;
+		rd.pressure = 1000.0f;
+		// The last few are only in the ring, as if not yet flushed
+		if (i < TESTROWS - 10)
+		{
+			GhHistAppend(&hw, rd);
+		}
+		GhRingPush(&ring, rd);
+	}
+	GhHistClose(&hw);
+
+	CHECK(GhSchedInit(&sch));
+	CHECK(GhSchedAddTask(&sch, "publish", TESTPUBLISH, Publish, NULL));
+	// Port 0: any free port
+	if (!GhHttpOpen(&srv, &sch, "127.0.0.1", 0))
+	{
+		fprintf(stderr, "httptest: can't listen on loopback\n");
+		return EXIT_FAILURE;
+	}
+	srv.logname = logname;
+	srv.rd = &rd;
+	srv.sets = &sets;
+	srv.ctrl = &ctrl;
+	srv.ring = &ring;
+	getsockname(srv.fd, (struct sockaddr *)&sin, &slen);
+	port = ntohs(sin.sin_port);
+
+	// Created after GhSchedInit() so SIGTERM stays blocked in the client
+	CHECK(pthread_create(&client, NULL, Client, NULL) == 0);
+	CHECK(GhSchedRun(&sch) == 1);
+	pthread_join(client, NULL);
+	GhHttpClose(&srv);
+	GhSchedClose(&sch);
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", tmpl);
+	if (system(cmd) != 0)
+	{
+		fprintf(stderr, "httptest: can't remove %s\n", tmpl);
+	}
+	if (failures > 0)
+	{
+		fprintf(stderr, "httptest: %d failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	fprintf(stdout, "httptest: ok\n");
+	return EXIT_SUCCESS;
+}
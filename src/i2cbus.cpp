@@ -0,0 +1,149 @@
+/**
+ * @file i2cbus.cpp
+ * @details A register read is one I2C_RDWR ioctl holding the sub-address
+ *          write and the read, so a burst of any length costs a single
+ *          transaction with a repeated start.
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "i2cbus.h"
+
+/**
+ * @brief LinuxI2c::LinuxI2c
+ * @param device the bus node, /dev/i2c-1 on the Raspberry Pi
+ */
+LinuxI2c::LinuxI2c(const char *device)
+{
+    fd = open(device, O_RDWR | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        // A wedged transfer fails fast instead of stalling the sampler
+        ioctl(fd, I2C_TIMEOUT, I2C_XFER_TIMEOUT);
+    }
+}
+
+LinuxI2c::~LinuxI2c(void)
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+bool LinuxI2c::Read(uint8_t address, uint8_t reg, uint8_t *buf, size_t len)
+{
+    struct i2c_msg msgs[2];
+    struct i2c_rdwr_ioctl_data xfer;
+
+    if (fd < 0 || len == 0 || len > I2C_MAX_TRANSFER)
+    {
+        return false;
+    }
+    msgs[0].addr = address;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = &reg;
+    msgs[1].addr = address;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = len;
+    msgs[1].buf = buf;
+    xfer.msgs = msgs;
+    xfer.nmsgs = 2;
+    return ioctl(fd, I2C_RDWR, &xfer) == 2;
+}
+
+bool LinuxI2c::Write(uint8_t address, uint8_t reg, uint8_t value)
+{
+    struct i2c_msg msg;
+    struct i2c_rdwr_ioctl_data xfer;
+    uint8_t out[2];
+
+    if (fd < 0)
+    {
+        return false;
+    }
+    out[0] = reg;
+    out[1] = value;
+    msg.addr = address;
+    msg.flags = 0;
+    msg.len = 2;
+    msg.buf = out;
+    xfer.msgs = &msg;
+    xfer.nmsgs = 1;
+    return ioctl(fd, I2C_RDWR, &xfer) == 1;
+}
+
+/**
+ * @brief FakeI2c::FakeI2c
+ * @details Registers read as 0 until Set() or Write(). Frames queued with
+ *          PushFifo() are served, oldest first, by reads starting at that
+ *          register, the way a sensor FIFO replays its output registers.
+ */
+FakeI2c::FakeI2c(void)
+{
+    reads = 0;
+    writes = 0;
+}
+
+void FakeI2c::Set(uint8_t address, uint8_t reg, uint8_t value)
+{
+    regs[(address << 8) | reg] = value;
+}
+
+uint8_t FakeI2c::Get(uint8_t address, uint8_t reg) const
+{
+    std::map<uint16_t, uint8_t>::const_iterator it;
+
+    it = regs.find((address << 8) | reg);
+    return it == regs.end() ? 0 : it->second;
+}
+
+void FakeI2c::PushFifo(uint8_t address, uint8_t reg, const uint8_t *frame, size_t len)
+{
+    std::deque<uint8_t> &q = fifo[(address << 8) | reg];
+
+    q.insert(q.end(), frame, frame + len);
+}
+
+bool FakeI2c::Read(uint8_t address, uint8_t reg, uint8_t *buf, size_t len)
+{
+    std::map<uint16_t, std::deque<uint8_t> >::iterator it;
+    uint8_t sub;
+    size_t i;
+
+    reads++;
+    sub = reg & ~I2C_AUTO_INCREMENT;
+    it = fifo.find((address << 8) | sub);
+    if (it != fifo.end() && !it->second.empty())
+    {
+        if (it->second.size() < len)
+        {
+            return false;
+        }
+        for (i = 0; i < len; i++)
+        {
+            buf[i] = it->second.front();
+            it->second.pop_front();
+        }
+        return true;
+    }
+    for (i = 0; i < len; i++)
+    {
+        buf[i] = Get(address, sub);
+        if (reg & I2C_AUTO_INCREMENT)
+        {
+            sub++;
+        }
+    }
+    return true;
+}
+
+bool FakeI2c::Write(uint8_t address, uint8_t reg, uint8_t value)
+{
+    writes++;
+    Set(address, reg, value);
+    return true;
+}
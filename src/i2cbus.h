@@ -0,0 +1,60 @@
+/**
+ * @file i2cbus.h
+ * @details Register-level I2C transport for the Sense HAT sensor drivers.
+ *          LinuxI2c talks to /dev/i2c-N; FakeI2c is a register map that
+ *          stands in for the chips when there is no hardware.
+ */
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+
+// Sub-address bit asking ST sensors to auto-increment on multi-byte reads
+#define I2C_AUTO_INCREMENT 0x80
+#define I2C_MAX_TRANSFER 256
+// Adapter transfer timeout in 10 ms units, inside the sampler's read deadline
+#define I2C_XFER_TIMEOUT 1
+
+class I2cBus
+{
+public:
+    virtual ~I2cBus(void) {}
+    virtual bool Read(uint8_t address, uint8_t reg, uint8_t *buf, size_t len) = 0;
+    virtual bool Write(uint8_t address, uint8_t reg, uint8_t value) = 0;
+};
+
+class LinuxI2c : public I2cBus
+{
+public:
+    LinuxI2c(const char *device);
+    ~LinuxI2c(void);
+    bool IsOpen(void) const { return fd >= 0; }
+    bool Read(uint8_t address, uint8_t reg, uint8_t *buf, size_t len);
+    bool Write(uint8_t address, uint8_t reg, uint8_t value);
+
+private:
+    int fd;
+};
+
+class FakeI2c : public I2cBus
+{
+public:
+    FakeI2c(void);
+    void Set(uint8_t address, uint8_t reg, uint8_t value);
+    uint8_t Get(uint8_t address, uint8_t reg) const;
+    void PushFifo(uint8_t address, uint8_t reg, const uint8_t *frame, size_t len);
+    bool Read(uint8_t address, uint8_t reg, uint8_t *buf, size_t len);
+    bool Write(uint8_t address, uint8_t reg, uint8_t value);
+
+    unsigned reads;
+    unsigned writes;
+
+private:
+    std::map<uint16_t, uint8_t> regs;
+    std::map<uint16_t, std::deque<uint8_t> > fifo;
+};
+
+#endif // I2CBUS_H
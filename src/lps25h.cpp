@@ -0,0 +1,139 @@
+/**
+ * @file lps25h.cpp
+ * @details In FIFO mean mode the chip averages on its own and the output
+ *          registers hold the running mean, so a read is one burst of the
+ *          status and the five data bytes. In stream mode Drain() empties
+ *          the FIFO in one burst: with the FIFO enabled the register
+ *          pointer rolls back from TEMP_OUT_H to PRESS_OUT_XL after every
+ *          frame.
+ */
+#include "lps25h.h"
+
+/**
+ * @brief Lps25h::Lps25h
+ * @param bus the transport, shared with the other sensors on the HAT
+ */
+Lps25h::Lps25h(I2cBus &bus, uint8_t address) : bus(bus), address(address)
+{
+    fifoMode = LPS25H_FIFO_BYPASS;
+    valid = false;
+    lastPressure = 0;
+    lastTemperature = 0;
+}
+
+/**
+ * @brief Lps25h::Init
+ * @param odr one of LPS25H_ODR_*
+ * @param fifoMode LPS25H_FIFO_BYPASS, _STREAM or _MEAN
+ * @param meanSamples samples averaged in mean mode: 2, 4, 8, 16 or 32
+ * @return false if the chip does not answer as an LPS25H
+ */
+bool Lps25h::Init(uint8_t odr, uint8_t fifoMode, int meanSamples, uint8_t resConf)
+{
+    uint8_t id;
+
+    if (!bus.Read(address, LPS25H_WHO_AM_I, &id, 1) || id != LPS25H_ID)
+    {
+        return false;
+    }
+    if (meanSamples < 2)
+    {
+        meanSamples = 2;
+    }
+    if (meanSamples > LPS25H_FIFO_DEPTH)
+    {
+        meanSamples = LPS25H_FIFO_DEPTH;
+    }
+    this->fifoMode = fifoMode;
+    valid = false;
+    // Configure powered down, then start conversions
+    return bus.Write(address, LPS25H_CTRL_REG1, 0)
+        && bus.Write(address, LPS25H_RES_CONF, resConf)
+        && bus.Write(address, LPS25H_FIFO_CTRL, fifoMode | ((meanSamples - 1) & LPS25H_FIFO_FSS))
+        && bus.Write(address, LPS25H_CTRL_REG2, fifoMode == LPS25H_FIFO_BYPASS ? 0 : LPS25H_FIFO_EN)
+        && bus.Write(address, LPS25H_CTRL_REG1, LPS25H_PD | LPS25H_BDU | odr);
+}
+
+float Lps25h::Pressure(const uint8_t *frame)
+{
+    int32_t raw;
+
+    raw = (int32_t)((uint32_t)frame[2] << 24 | (uint32_t)frame[1] << 16 | (uint32_t)frame[0] << 8) >> 8;
+    return raw / 4096.0f;
+}
+
+float Lps25h::Temperature(const uint8_t *frame)
+{
+    int16_t raw;
+
+    raw = (int16_t)(frame[4] << 8 | frame[3]);
+    return 42.5f + raw / 480.0f;
+}
+
+/**
+ * @brief Lps25h::Read
+ * @details Returns the previous values when no conversion finished since
+ *          the last read.
+ * @return false until the first conversion, or on a bus error
+ */
+bool Lps25h::Read(float &pressure, float &temperature)
+{
+    uint8_t buf[1 + LPS25H_FRAME];
+
+    if (!bus.Read(address, LPS25H_STATUS_REG | I2C_AUTO_INCREMENT, buf, sizeof(buf)))
+    {
+        return false;
+    }
+    if (buf[0] & LPS25H_P_DA)
+    {
+        lastPressure = Pressure(buf + 1);
+        lastTemperature = Temperature(buf + 1);
+        valid = true;
+    }
+    if (!valid)
+    {
+        return false;
+    }
+    pressure = lastPressure;
+    temperature = lastTemperature;
+    return true;
+}
+
+/**
+ * @brief Lps25h::Drain
+ * @details Stream mode only; other modes return the single Read() value.
+ * @return the number of samples copied, oldest first
+ */
+int Lps25h::Drain(float *pressure, float *temperature, int max)
+{
+    uint8_t status;
+    uint8_t buf[LPS25H_FIFO_DEPTH * LPS25H_FRAME];
+    int i, n;
+
+    if (fifoMode != LPS25H_FIFO_STREAM)
+    {
+        return max > 0 && Read(pressure[0], temperature[0]) ? 1 : 0;
+    }
+    if (!bus.Read(address, LPS25H_FIFO_STATUS, &status, 1))
+    {
+        return 0;
+    }
+    n = (status & LPS25H_FIFO_FULL) ? LPS25H_FIFO_DEPTH : status & LPS25H_FIFO_FSS;
+    if (n > max)
+    {
+        n = max;
+    }
+    if (n == 0 || !bus.Read(address, LPS25H_PRESS_OUT_XL | I2C_AUTO_INCREMENT, buf, n * LPS25H_FRAME))
+    {
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+    {
+        pressure[i] = Pressure(buf + i * LPS25H_FRAME);
+        temperature[i] = Temperature(buf + i * LPS25H_FRAME);
+    }
+    lastPressure = pressure[n - 1];
+    lastTemperature = temperature[n - 1];
+    valid = true;
+    return n;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file lps25h.h
+ * @details LPS25H pressure and temperature sensor driver.
+ */
+#ifndef LPS25H_H
+#define LPS25H_H
+
+#include "i2cbus.h"
+
+#define LPS25H_ADDRESS 0x5C
+#define LPS25H_ID 0xBD
+
+#define LPS25H_WHO_AM_I 0x0F
+#define LPS25H_RES_CONF 0x10
+#define LPS25H_CTRL_REG1 0x20
+#define LPS25H_CTRL_REG2 0x21
+#define LPS25H_STATUS_REG 0x27
+#define LPS25H_PRESS_OUT_XL 0x28
+#define LPS25H_FIFO_CTRL 0x2E
+#define LPS25H_FIFO_STATUS 0x2F
+
+#define LPS25H_PD 0x80
+#define LPS25H_BDU 0x04
+#define LPS25H_ODR_1HZ 0x10
+#define LPS25H_ODR_7HZ 0x20
+#define LPS25H_ODR_12HZ5 0x30
+#define LPS25H_ODR_25HZ 0x40
+#define LPS25H_FIFO_EN 0x40
+#define LPS25H_P_DA 0x02
+#define LPS25H_T_DA 0x01
+#define LPS25H_FIFO_FULL 0x40
+#define LPS25H_FIFO_EMPTY 0x20
+#define LPS25H_FIFO_FSS 0x1F
+
+// FIFO_CTRL F_MODE; mean mode keeps a running mean of 2..32 samples
+#define LPS25H_FIFO_BYPASS 0x00
+#define LPS25H_FIFO_STREAM 0x40
+#define LPS25H_FIFO_MEAN 0xC0
+#define LPS25H_FIFO_DEPTH 32
+#define LPS25H_FRAME 5
+
+// AVGT 16, AVGP 32: the setting the datasheet gives for FIFO mean mode
+#define LPS25H_RES_CONF_MEAN 0x05
+
+class Lps25h
+{
+public:
+    Lps25h(I2cBus &bus, uint8_t address = LPS25H_ADDRESS);
+    bool Init(uint8_t odr, uint8_t fifoMode, int meanSamples, uint8_t resConf = LPS25H_RES_CONF_MEAN);
+    bool Read(float &pressure, float &temperature);
+    int Drain(float *pressure, float *temperature, int max);
+
+private:
+    static float Pressure(const uint8_t *frame);
+    static float Temperature(const uint8_t *frame);
+
+    I2cBus &bus;
+    uint8_t address;
+    uint8_t fifoMode;
+    bool valid;
+    float lastPressure;
+    float lastTemperature;
+};
+
+#endif // LPS25H_H
@@ -14,174 +14,138 @@
 #include <iostream>
 #include <stdio.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
 #include "sensehat.h"
 #include "font.h"
 
-#define NUMBER_OF_TRIES_BEFORE_FAILURE 1000
+#define INIT_BACKOFF_MIN_US 100
+#define INIT_BACKOFF_MAX_US 100000
+#define INIT_TIMEOUT_MS 3000
 #if SENSEHAT_EMULATOR
 int numReadings = 0;    // python threads maximum counter
 #endif
 
-static int is_framebuffer_device(const struct dirent *dir)
+static uint64_t monotonic_ms(void)
 {
-	return strncmp(FB_DEV_NAME, dir->d_name,strlen(FB_DEV_NAME)-1) == 0;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-static int open_fbdev(const char *dev_name)
+/**
+ * @brief SignalsBlocked
+ * @details Blocks SIGINT and SIGTERM in the calling thread while in scope.
+ *          Threads started meanwhile inherit the mask, so those signals
+ *          only ever reach the main loop and never kill the process from
+ *          a worker before it can flush its logs.
+ */
+class SignalsBlocked
 {
-	struct dirent **namelist;
-	int i, ndev;
-	int fd = -1;
-	struct fb_fix_screeninfo fix_info;
-
-	ndev = scandir(DEV_FB, &namelist, is_framebuffer_device, versionsort);
-	if (ndev <= 0) { return ndev; }
-
-	for (i = 0; i < ndev; i++)
+public:
+	SignalsBlocked(void)
 	{
-		char fname[64];
+		sigset_t mask;
 
-		snprintf(fname, sizeof(fname),"%s/%s", DEV_FB, namelist[i]->d_name);
-		fd = open(fname, O_RDWR);
-		if (fd < 0) { continue; }
-		ioctl(fd, FBIOGET_FSCREENINFO, &fix_info);
-		if (strcmp(dev_name, fix_info.id) == 0){ break; }
-		close(fd);
-		fd = -1;
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGINT);
+		sigaddset(&mask, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &mask, &saved);
 	}
-	for (i = 0; i < ndev; i++) { free(namelist[i]); }
-	return fd;
-}
-
-static int is_event_device(const struct dirent *dir)
-{
-	return strncmp(EVENT_DEV_NAME, dir->d_name,strlen(EVENT_DEV_NAME)-1) == 0;
-}
+	~SignalsBlocked(void)
+	{
+		pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	}
+private:
+	sigset_t saved;
+};
 
-static int open_evdev(const char *dev_name)
+/**
+ * @brief retry_backoff
+ * @details Retries attempt with exponentially growing sleeps, from
+ *          INIT_BACKOFF_MIN_US up to INIT_BACKOFF_MAX_US, for at most
+ *          INIT_TIMEOUT_MS.
+ * @return false if attempt never succeeded
+ */
+static bool retry_backoff(const std::function<bool(void)> &attempt)
 {
-	int tries;
-	struct dirent **namelist;
-	int i, ndev;
-	int fd = -1;
-	int sortie = false;
-	char fname[64];
-	char name[256];
+	uint64_t deadline = monotonic_ms() + INIT_TIMEOUT_MS;
+	useconds_t delay = INIT_BACKOFF_MIN_US;
 
-	tries = 0;
-	while(true)
+	while (!attempt())
 	{
-		ndev = scandir(DEV_INPUT_EVENT, &namelist, is_event_device, versionsort);
-		if (ndev <= 0)
-		{
-			tries++;
-			usleep(100);
-		}
-		else
-		{
-			break;
-		}
-		if (tries > NUMBER_OF_TRIES_BEFORE_FAILURE)
-		{
-			exit (EXIT_FAILURE);
-		}
+		if (monotonic_ms() >= deadline) { return false; }
+		usleep(delay);
+		delay = std::min<useconds_t>(delay * 2, INIT_BACKOFF_MAX_US);
 	}
-
-	i=0;
-	do
-	{
-		snprintf(fname, sizeof(fname),"%s/%s", DEV_INPUT_EVENT, namelist[i++]->d_name);
-		tries = 0;
-		while(true)
-		{
-			fd = open(fname, O_RDONLY );
-			if (fd < 0)
-			{
-				tries++;
-				usleep(100);
-			}
-			else
-			{
-				break;
-			}
-			if (tries > NUMBER_OF_TRIES_BEFORE_FAILURE)
-			{
-				exit (EXIT_FAILURE);
-			}
-		}
-		ioctl(fd, EVIOCGNAME(sizeof(name)), name);
-		if (strcmp(dev_name, name) != 0) { close(fd); }
-		else { sortie = true; }
-		}
-    while( i<ndev && sortie != true);
-
-	for (i = 0; i < ndev; i++) { free(namelist[i]); }
-	return fd;
+	return true;
 }
 
-uint16_t handle_events(int evfd)
+#if SENSEHAT_EMULATOR
+/**
+ * @brief ready_future
+ * @return a future that is already satisfied with value
+ */
+static std::shared_future<bool> ready_future(bool value)
 {
-	struct input_event ev;
-	int rd;
-	uint16_t retour = 0 ;
-	int flag;
-
-	flag = fcntl(evfd,F_GETFL,0);
-	fcntl(evfd,F_SETFL,flag | O_NONBLOCK | O_NOCTTY);
+	std::promise<bool> done;
 
-	rd = read(evfd, &ev, sizeof(struct input_event));
-	if(rd > 0)
-	{
-		if(ev.type == EV_KEY && ev.value == 1) { retour = ev.code; }
-    }
-    return retour;
+	done.set_value(value);
+	return done.get_future().share();
 }
+#endif
 
 /**
  * @brief SenseHat::SenseHat
  * @details Constructeur de la classe, initialise les attributs
  *          par défaut imu, leds, Joystick, buffer.
+ *          The LEDs, joystick and environmental sensors come up in parallel
+ *          in the background and report through LedsReady(), JoystickReady()
+ *          and SensorsReady(); the IMU is only brought up on first use.
  */
-SenseHat::SenseHat(void)
+SenseHat::SenseHat(void) : devices(DEV_FB, DEV_INPUT_EVENT, DEVICE_CACHE_PATH), cpuTempFile(CPU_TEMP_PATH)
 {
+  fb = NULL;
+  joystick = -1;
+  joystickHead = 0;
+  joystickTail = 0;
+  joystickDropped = 0;
+  joystickStop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  joystickNotify = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  joystickEpoll = -1;
+  hotplugStop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  imuSeq = 0;
+  imuStop = false;
+  cpuTemperature = 0.0f;
+  cpuStop = false;
+  memset(&imuSample, 0, sizeof(imuSample));
+  memset(&back, 0, sizeof(back));
+  memset(&shown, 0, sizeof(shown));
+  buffer=" ";
+  color=BLUE;
+  rotation = 0;
+  frameDepth = 0;
+  displayStop = false;
+  displayOrder = 0;
+  idleSet = false;
+  idleDirty = false;
 #if SENSEHAT_EMULATOR
 	Py_Initialize();
+  ledsReady = ready_future(true);
+  joystickReady = ready_future(true);
+  sensorsReady = ready_future(true);
 #else
-  int tries;
   settings = new RTIMUSettings("RTIMULib");
-
-  tries = 0;
-  while(true)
-  {
-    imu = RTIMU::createIMU(settings);
-    if ((imu == NULL) || (imu->IMUType() == RTIMU_TYPE_NULL))
-    {
-      tries++;
-      usleep(100);
-    }
-    else
-    {
-      break;
-    }
-    if (tries > NUMBER_OF_TRIES_BEFORE_FAILURE)
-    {
-      exit (EXIT_FAILURE);
-    }
-  }
-
-  imu->IMUInit();
-  imu->setSlerpPower(0.02);
-  imu->setGyroEnable(true);
-  imu->setAccelEnable(true);
-  imu->setCompassEnable(true);
-  InitializeLeds();
-  InitializeJoystick();
-  InitializeHumidity();
-  InitializePressure();
+  imu = NULL;
+  pressure = NULL;
+  humidity = NULL;
+  SignalsBlocked blocked;
+  ledsReady = std::async(std::launch::async, &SenseHat::InitializeLeds, this).share();
+  joystickReady = std::async(std::launch::async, &SenseHat::InitializeJoystick, this).share();
+  sensorsReady = std::async(std::launch::async, &SenseHat::InitializeSensors, this).share();
+  hotplugThread = std::thread(&SenseHat::HotplugWorker, this);
 #endif
-  buffer=" ";
-  color=BLUE;
-  rotation = 0;
 }
 
 /**
@@ -190,6 +154,20 @@ SenseHat::SenseHat(void)
  */
 SenseHat::~SenseHat(void)
 {
+    ledsReady.wait();
+    joystickReady.wait();
+    sensorsReady.wait();
+#if SENSEHAT_EMULATOR
+#else
+    StopHotplug();
+#endif
+    StopDisplay();
+    StopJoystick();
+    StopCpuTemperature();
+#if SENSEHAT_EMULATOR
+#else
+    StopImu();
+#endif
 #if SENSEHAT_EMULATOR
 	Py_Finalize();
 #else
@@ -222,6 +200,7 @@ void SenseHat::SetColor(uint16_t _color)
 
 void SenseHat::SetRotation(uint16_t _rotation)
 {
+	std::lock_guard<std::mutex> lock(displayLock);
 	rotation = _rotation;
 }
 
@@ -268,7 +247,9 @@ void SenseHat::LightPixel(int row, int column, uint16_t color)
     if(column < 0)
 	column = 0;
 
-    fb->pixel[row%8][column%8] = color;
+    std::lock_guard<std::mutex> lock(displayLock);
+    back.pixel[row%8][column%8] = color;
+    if (frameDepth == 0) { Commit(); }
 #endif
 }
 
@@ -282,7 +263,8 @@ uint16_t SenseHat::GetPixel(int row, int column)
 {
 	if(row < 0) { row = 0; }
 	if(column < 0) { column = 0; }
-	return fb->pixel[row%8][column%8] ;
+	std::lock_guard<std::mutex> lock(displayLock);
+	return back.pixel[row%8][column%8] ;
 }
 
 /**
@@ -290,6 +272,18 @@ uint16_t SenseHat::GetPixel(int row, int column)
  * @param pattern uint16_t 8x8 arrays
  */
 void SenseHat::ViewPattern(uint16_t pattern[][8])
+{
+	std::lock_guard<std::mutex> lock(displayLock);
+	DrawPattern(pattern);
+}
+
+/**
+ * @brief SenseHat::DrawPattern
+ * @details ViewPattern() for callers that hold displayLock, which guards
+ *          the back buffer, frameDepth and rotation against the display
+ *          thread.
+ */
+void SenseHat::DrawPattern(uint16_t pattern[][8])
 {
 	for(int row=0; row <8 ; row++)
 	{
@@ -299,21 +293,22 @@ void SenseHat::ViewPattern(uint16_t pattern[][8])
 			{
 				case   90:
 				case -270:
-					fb->pixel[7 - column][row] = pattern[row][column];
+					back.pixel[7 - column][row] = pattern[row][column];
 					break;
 				case  180:
 				case -180:
-					fb->pixel[7 - row][7 - column] = pattern[row][column];
+					back.pixel[7 - row][7 - column] = pattern[row][column];
 					break;
 				case  270:
 				case  -90:
-					fb->pixel[column][7 - row] = pattern[row][column];
+					back.pixel[column][7 - row] = pattern[row][column];
 					break;
 				default:
-					fb->pixel[row][column] = pattern[row][column];
+					back.pixel[row][column] = pattern[row][column];
 			}
 		}
     }
+    if (frameDepth == 0) { Commit(); }
 }
 
 /**
@@ -323,6 +318,7 @@ void SenseHat::ViewPattern(uint16_t pattern[][8])
 void SenseHat::RotatePattern(int angle)
 {
     uint16_t tabAux[8][8];
+    std::lock_guard<std::mutex> lock(displayLock);
 
     for(int row=0; row <8 ; row++)
     {
@@ -332,22 +328,22 @@ void SenseHat::RotatePattern(int angle)
             {
                 case   90:
                 case -270:
-                    tabAux[7 - column][row] = fb->pixel[row][column];
+                    tabAux[7 - column][row] = back.pixel[row][column];
                     break;
                 case  180:
                 case -180:
-                    tabAux[7 - row][7 - column] = fb->pixel[row][column];
+                    tabAux[7 - row][7 - column] = back.pixel[row][column];
                     break;
                 case  270:
                 case  -90:
-                    tabAux[column][7 - row] = fb->pixel[row][column];
+                    tabAux[column][7 - row] = back.pixel[row][column];
                     break;
                 default:
-                    tabAux[row][column] = fb->pixel[row][column];
+                    tabAux[row][column] = back.pixel[row][column];
             }
         }
     }
-    ViewPattern(tabAux);
+    DrawPattern(tabAux);
 }
 
 /**
@@ -381,7 +377,54 @@ void SenseHat::WipeScreen(uint16_t color)
 		"sense.clear()\n"
 		);
 #else
-	memset(fb, color, 128);
+	std::lock_guard<std::mutex> lock(displayLock);
+	for(int row=0; row <8 ; row++)
+	{
+		for(int column=0 ; column <8 ; column++)
+		{
+			back.pixel[row][column] = color;
+		}
+	}
+	if (frameDepth == 0) { Commit(); }
+#endif
+}
+
+/**
+ * @brief SenseHat::BeginFrame
+ * @details Drawing calls made until the matching Present() only touch the
+ *          back buffer. Outside a frame every call is committed at once.
+ */
+void SenseHat::BeginFrame(void)
+{
+	std::lock_guard<std::mutex> lock(displayLock);
+	frameDepth++;
+}
+
+/**
+ * @brief SenseHat::Present
+ * @details Ends a frame and commits the back buffer to the LED matrix.
+ */
+void SenseHat::Present(void)
+{
+	std::lock_guard<std::mutex> lock(displayLock);
+	if (frameDepth > 0) { frameDepth--; }
+	if (frameDepth == 0) { Commit(); }
+}
+
+/**
+ * @brief SenseHat::Commit
+ * @details Copies the whole 128-byte back buffer to the framebuffer in one
+ *          pass, or does nothing if it matches the last committed frame.
+ */
+void SenseHat::Commit(void)
+{
+#if SENSEHAT_EMULATOR
+#else
+	ledsReady.wait();
+	std::lock_guard<std::mutex> guard(fbLock);
+	if (fb == NULL || memcmp(&back, &shown, sizeof(back)) == 0) { return; }
+	memcpy(fb, &back, sizeof(back));
+	shown = back;
 #endif
 }
 
@@ -392,7 +435,200 @@ void SenseHat::WipeScreen(uint16_t color)
  */
 char SenseHat::ScanJoystick(void)
 {
-	return handle_events(joystick);
+	JoystickEvent ev;
+
+	StartJoystick();
+	while (ReadJoystick(ev))
+	{
+		if (ev.type == JOYSTICK_PRESS) { return ev.code; }
+	}
+	return 0;
+}
+
+/**
+ * @brief SenseHat::JoystickFd
+ * @return a descriptor that polls readable while joystick events are queued
+ */
+int SenseHat::JoystickFd(void)
+{
+	StartJoystick();
+	return joystickNotify;
+}
+
+/**
+ * @brief SenseHat::SetJoystickCallback
+ * @details The callback runs on the input thread for every decoded event,
+ *          before the event is queued for ReadJoystick().
+ */
+void SenseHat::SetJoystickCallback(std::function<void(const JoystickEvent &)> callback)
+{
+	std::lock_guard<std::mutex> lock(joystickLock);
+	joystickCallback = callback;
+}
+
+/**
+ * @brief SenseHat::ReadJoystick
+ * @param ev JoystickEvent receives the oldest queued event
+ * @return false when the queue is empty
+ */
+bool SenseHat::ReadJoystick(JoystickEvent &ev)
+{
+	uint32_t head, tail;
+	uint64_t count;
+
+	head = joystickHead.load(std::memory_order_relaxed);
+	tail = joystickTail.load(std::memory_order_acquire);
+	if (head == tail)
+	{
+		// Clear the wakeup, then look again for an event queued meanwhile
+		if (read(joystickNotify, &count, sizeof(count)) < 0) { count = 0; }
+		tail = joystickTail.load(std::memory_order_acquire);
+		if (head == tail) { return false; }
+	}
+	ev = joystickQueue[head % JOYSTICK_QUEUE];
+	joystickHead.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+void SenseHat::PublishJoystick(uint16_t code, uint8_t type, uint64_t time)
+{
+	JoystickEvent ev;
+	uint32_t head, tail;
+	uint64_t one = 1;
+
+	ev.code = code;
+	ev.type = type;
+	ev.time = time;
+	{
+		std::lock_guard<std::mutex> lock(joystickLock);
+		if (joystickCallback) { joystickCallback(ev); }
+	}
+	tail = joystickTail.load(std::memory_order_relaxed);
+	head = joystickHead.load(std::memory_order_acquire);
+	if (tail - head >= JOYSTICK_QUEUE)
+	{
+		joystickDropped++;
+		return;
+	}
+	joystickQueue[tail % JOYSTICK_QUEUE] = ev;
+	joystickTail.store(tail + 1, std::memory_order_release);
+	if (write(joystickNotify, &one, sizeof(one)) < 0) { joystickDropped++; }
+}
+
+void SenseHat::StartJoystick(void)
+{
+	std::call_once(joystickOnce, [this]
+	{
+		if (joystickStop < 0) { return; }
+		SignalsBlocked blocked;
+		joystickThread = std::thread(&SenseHat::JoystickWorker, this);
+	});
+}
+
+void SenseHat::StopJoystick(void)
+{
+	uint64_t one = 1;
+
+	if (joystickThread.joinable())
+	{
+		if (write(joystickStop, &one, sizeof(one)) < 0) { return; }
+		joystickThread.join();
+	}
+}
+
+/**
+ * @brief SenseHat::JoystickWorker
+ * @details Sleeps in epoll on the evdev descriptor, drains every pending
+ *          input_event in bursts and decodes press, release and repeat.
+ *          The epoll timeout is set to the long-press deadline of the key
+ *          being held, so long presses are reported without polling.
+ */
+void SenseHat::JoystickWorker(void)
+{
+	struct epoll_event ev[2];
+	struct input_event burst[JOYSTICK_BURST];
+	uint16_t held = 0;
+	uint64_t pressed = 0, now;
+	bool longSent = false;
+	int ep, fd, n, i, timeout;
+	ssize_t rd;
+
+	joystickReady.wait();
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	if (ep < 0) { return; }
+	memset(ev, 0, sizeof(ev));
+	ev[0].events = EPOLLIN;
+	ev[0].data.fd = joystickStop;
+	epoll_ctl(ep, EPOLL_CTL_ADD, joystickStop, &ev[0]);
+	// From here on OpenJoystick() adds a reopened device itself
+	joystickEpoll = ep;
+	fd = joystick;
+	if (fd >= 0)
+	{
+		ev[0].data.fd = fd;
+		epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev[0]);
+	}
+
+	while (true)
+	{
+		timeout = -1;
+		if (held != 0 && !longSent)
+		{
+			now = monotonic_ms();
+			timeout = (pressed + JOYSTICK_LONGPRESS_MS > now) ? (int)(pressed + JOYSTICK_LONGPRESS_MS - now) : 0;
+		}
+		n = epoll_wait(ep, ev, 2, timeout);
+		if (n < 0)
+		{
+			if (errno == EINTR) { continue; }
+			break;
+		}
+		if (n == 0 && held != 0 && !longSent)
+		{
+			PublishJoystick(held, JOYSTICK_LONGPRESS, monotonic_ms());
+			longSent = true;
+			continue;
+		}
+		for (i = 0; i < n; i++)
+		{
+			if (ev[i].data.fd == joystickStop)
+			{
+				joystickEpoll = -1;
+				close(ep);
+				return;
+			}
+		}
+		fd = joystick;
+		if (fd < 0) { continue; }
+		while ((rd = read(fd, burst, sizeof(burst))) > 0)
+		{
+			now = monotonic_ms();
+			for (i = 0; i < (int)(rd / sizeof(struct input_event)); i++)
+			{
+				if (burst[i].type != EV_KEY) { continue; }
+				if (burst[i].value == JOYSTICK_PRESS)
+				{
+					held = burst[i].code;
+					pressed = now;
+					longSent = false;
+				}
+				else if (burst[i].value == JOYSTICK_RELEASE && burst[i].code == held)
+				{
+					held = 0;
+				}
+				PublishJoystick(burst[i].code, burst[i].value, now);
+			}
+		}
+		if (rd < 0 && errno != EAGAIN && errno != EINTR)
+		{
+			// Device went away: drop it until the hotplug thread reopens it
+			epoll_ctl(ep, EPOLL_CTL_DEL, fd, NULL);
+			if (joystick.compare_exchange_strong(fd, -1)) { close(fd); }
+			held = 0;
+		}
+	}
+	joystickEpoll = -1;
+	close(ep);
 }
 
 /**
@@ -448,6 +684,38 @@ COLOR_SENSEHAT SenseHat::ConvertRGB565(std::string hexCode)
    return ConvertRGB565(r,g,b);
 }
 
+/**
+ * @brief SenseHat::ReadEnvironment
+ * @return EnvSample temperature, pressure, humidity and CPU temperature
+ * @details One LPS25H read supplies both the raw temperature and the
+ *          pressure, so the pressure sensor is only asked once. The CPU
+ *          temperature comes from the background sampler and costs no I/O.
+ */
+EnvSample SenseHat::ReadEnvironment(void)
+{
+    EnvSample env;
+    struct timespec ts;
+
+    env.rtime = time(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    env.mtime = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#if SENSEHAT_EMULATOR
+    env.rawTemperature = getRawTemperature();
+    env.cpuTemperature = getCpuTemperature();
+    env.pressure = GetPressure();
+    env.humidity = GetHumidity();
+#else
+    env.rawTemperature = nan("");
+    env.pressure = nan("");
+    env.humidity = nan("");
+    readPressure(env.pressure, env.rawTemperature);
+    readHumidity(env.humidity);
+    env.cpuTemperature = getCpuTemperature();
+#endif
+    env.temperature = correctTemperature(env.rawTemperature, env.cpuTemperature);
+    return env;
+}
+
 /**
  * @brief SenseHat::GetTemperature
  * @return float la valeur de la température exprimée en °C,
@@ -501,34 +769,121 @@ float SenseHat::getRawTemperature(void)
 	fclose(fp);
     senseHatTemp = reading;
 #else
-	RTIMU_DATA data;
+	float press;
 
-    pressure->pressureRead(data);
-    senseHatTemp = data.temperature;
+    senseHatTemp = nan("");
+    readPressure(press, senseHatTemp);
 #endif
     return senseHatTemp;
 }
 
+/**
+ * @brief SysfsReader::SysfsReader
+ * @details Keeps a sysfs attribute open; each read is one pread() at offset
+ *          0, which makes the kernel regenerate the value.
+ */
+SysfsReader::SysfsReader(const char *path)
+{
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+}
+
+SysfsReader::~SysfsReader(void)
+{
+    if (fd >= 0) { close(fd); }
+}
+
+/**
+ * @brief SysfsReader::ReadInt
+ * @param value long receives the decimal integer in the attribute
+ * @return false if the attribute could not be read or holds no number
+ */
+bool SysfsReader::ReadInt(long &value)
+{
+    char buf[SYSFS_BUFSZ];
+    ssize_t n;
+    int i = 0;
+    bool negative = false;
+    long v = 0;
+
+    if (fd < 0) { return false; }
+    n = pread(fd, buf, sizeof(buf), 0);
+    if (n <= 0) { return false; }
+    while (i < n && (buf[i] == ' ' || buf[i] == '\t')) { i++; }
+    if (i < n && buf[i] == '-') { negative = true; i++; }
+    if (i >= n || buf[i] < '0' || buf[i] > '9') { return false; }
+    while (i < n && buf[i] >= '0' && buf[i] <= '9')
+    {
+        v = v * 10 + (buf[i] - '0');
+        i++;
+    }
+    value = negative ? -v : v;
+    return true;
+}
+
 /**
  * @brief SenseHat::getCpuTemperature
  * @return float la valeur de la température exprimée en °C,
+ * @details Smoothed value kept by the background sampler (EWMA with
+ *          CPU_TEMP_ALPHA every CPU_TEMP_PERIOD_MS), so a single noisy
+ *          reading does not swing the corrected temperature.
  */
 float SenseHat::getCpuTemperature(void)
 {
-    FILE *temperatureFile;
-    double T;
+    StartCpuTemperature();
+    return cpuTemperature.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief SenseHat::sampleCpuTemperature
+ * @return float one raw reading in °C, or NaN if it failed
+ */
+float SenseHat::sampleCpuTemperature(void)
+{
+    long milli;
+
+    if (!cpuTempFile.ReadInt(milli)) { return nan(""); }
+    return milli / 1000.0f;
+}
 
-    temperatureFile = fopen ("/sys/class/thermal/thermal_zone0/temp", "r");
-    if (temperatureFile == NULL)
+void SenseHat::StartCpuTemperature(void)
+{
+    std::call_once(cpuOnce, [this]
+    {
+        float first = sampleCpuTemperature();
+
+        // Same fallback as before when the thermal zone is missing
+        cpuTemperature = std::isnan(first) ? 0.0f : first;
+        SignalsBlocked blocked;
+        cpuThread = std::thread(&SenseHat::CpuTemperatureWorker, this);
+    });
+}
+
+void SenseHat::StopCpuTemperature(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(cpuLock);
+        cpuStop = true;
+    }
+    cpuWake.notify_one();
+    if (cpuThread.joinable()) { cpuThread.join(); }
+}
+
+void SenseHat::CpuTemperatureWorker(void)
+{
+    std::unique_lock<std::mutex> lock(cpuLock);
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    float sample, smoothed;
+
+    while (!cpuStop)
     {
-//      printf ("Error getting Core Temperature!")  ; //print some message
-      return (0);
+        next += std::chrono::milliseconds(CPU_TEMP_PERIOD_MS);
+        if (cpuWake.wait_until(lock, next, [this] { return cpuStop; })) { break; }
+        sample = sampleCpuTemperature();
+        if (std::isnan(sample)) { continue; }
+        smoothed = cpuTemperature.load(std::memory_order_relaxed);
+        smoothed += CPU_TEMP_ALPHA * (sample - smoothed);
+        cpuTemperature.store(smoothed, std::memory_order_relaxed);
     }
-    fscanf (temperatureFile, "%lf", &T);
-    T /= 1000;
-//    printf ("The temperature is %6.3f C.\n", T);
-    fclose (temperatureFile);
-    return(T);
 }
 
 
@@ -557,15 +912,9 @@ float SenseHat::GetPressure(void)
 	fclose(fp);
     pression = reading;
 #else
-    RTIMU_DATA data;
+    float temperature;
 
-    if (pressure->pressureRead(data))
-    {
-    	if (data.pressureValid)
-    	{
-    	    pression = data.pressure;
-        }
-    }
+    readPressure(pression, temperature);
 #endif
     return pression;
 }
@@ -595,15 +944,7 @@ float SenseHat::GetHumidity(void)
 	fclose(fp);
 	humidi = reading;
 #else
-	RTIMU_DATA data;
-
-    if (humidity->humidityRead(data))
-    {
-        if (data.humidityValid)
-        {
-            humidi = data.humidity;
-        }
-    }
+    readHumidity(humidi);
 #endif
     return humidi;
 }
@@ -632,12 +973,13 @@ void SenseHat::GetOrientation(float &pitch, float &roll, float &yaw)
 	fscanf(fp, "%f %f %f", &pitch,&roll,&yaw);
 	fclose(fp);
 #else
-    while (imu->IMURead())
+    ImuSample sample;
+
+    if (GetImuSample(sample))
     {
-        RTIMU_DATA imuData = imu->getIMUData();
-        pitch = imuData.gyro.x();
-        roll  = imuData.gyro.y();
-        yaw   = imuData.gyro.z();
+        pitch = sample.gyro[0];
+        roll  = sample.gyro[1];
+        yaw   = sample.gyro[2];
     }
 #endif
 }
@@ -666,12 +1008,13 @@ void SenseHat::GetAcceleration(float &x, float &y, float &z)
 	fscanf(fp, "%f %f %f", &z,&y,&z);
 	fclose(fp);
 #else
-    while (imu->IMURead())
+    ImuSample sample;
+
+    if (GetImuSample(sample))
     {
-        RTIMU_DATA imuData = imu->getIMUData();
-        x = imuData.accel.x();
-        y = imuData.accel.y();
-        z = imuData.accel.z();
+        x = sample.accel[0];
+        y = sample.accel[1];
+        z = sample.accel[2];
     }
 #endif
 }
@@ -701,12 +1044,13 @@ void SenseHat::GetMagnetism(float &x, float &y, float &z)
 	fscanf(fp, "%f %f %f", &z,&y,&z);
 	fclose(fp);
 #else
-    while (imu->IMURead())
+    ImuSample sample;
+
+    if (GetImuSample(sample))
     {
-        RTIMU_DATA imuData = imu->getIMUData();
-        x = imuData.compass.x();
-        y = imuData.compass.y();
-        z = imuData.compass.z();
+        x = sample.compass[0];
+        y = sample.compass[1];
+        z = sample.compass[2];
     }
 #endif
 }
@@ -731,124 +1075,414 @@ void SenseHat::GetSphericalMagnetism(float &ro, float &teta, float &delta)
 #if SENSEHAT_EMULATOR
 #else
 /**
- * @brief  SenseHat::InitializeLeds
+ * @brief SenseHat::GetImuSample
+ * @param sample ImuSample receives the latest gyro, accel, compass and fusion pose
+ * @return false if the IMU has not produced a sample yet
+ * @details Brings the IMU up on first use and waits for it. Afterwards this
+ *          is a seqlock read of the last published sample and never touches
+ *          I2C.
  */
-void SenseHat::InitializeLeds(void)
+bool SenseHat::GetImuSample(ImuSample &sample)
 {
-    int fbfd ;
-    int tries;
-    int tries2;
+    uint32_t before, after;
 
-    tries = 0;
-    tries2 = 0;
-    while(true)
+    if (!ImuReady().get())
     {
-      fbfd = open_fbdev("RPi-Sense FB");
-      if (fbfd > 0)
-      {
-          while (true)
-          {
-            fb = (struct fb_t*)mmap(0, 128, PROT_READ | PROT_WRITE, MAP_SHARED, fbfd, 0);
-            if (!fb)
-            {
-                tries2++;
-                usleep(100);
-                if (tries2 > NUMBER_OF_TRIES_BEFORE_FAILURE)
-                {
-                  printf("Failed to mmap.\n");
-                  exit(EXIT_FAILURE);
-                }
-            }
-            else
-            {
+        memset(&sample, 0, sizeof(sample));
+        return false;
+    }
+    while (true)
+    {
+        before = imuSeq.load(std::memory_order_acquire);
+        if (before & 1) { continue; }
+        memcpy(&sample, &imuSample, sizeof(sample));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = imuSeq.load(std::memory_order_relaxed);
+        if (before != after) { continue; }
+        // Right after start-up give the thread a moment for its first sample
+        if (sample.valid || before != 0
+            || std::chrono::steady_clock::now() >= imuStarted + std::chrono::milliseconds(IMU_FIRST_SAMPLE_MS)) { break; }
+        usleep(1000);
+    }
+    return sample.valid;
+}
 
-              memset(fb, 0, 128);
-              return;
-            }
+void SenseHat::PublishImu(const ImuSample &sample)
+{
+    uint32_t seq;
+
+    seq = imuSeq.load(std::memory_order_relaxed);
+    imuSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&imuSample, &sample, sizeof(sample));
+    imuSeq.store(seq + 2, std::memory_order_release);
+}
+
+/**
+ * @brief SenseHat::ImuReady
+ * @return a future that turns true once the IMU is initialized, false if
+ *         it could not be. The first call starts the IMU thread.
+ */
+std::shared_future<bool> SenseHat::ImuReady(void)
+{
+    std::call_once(imuOnce, [this]
+    {
+        imuReady = imuInit.get_future().share();
+        SignalsBlocked blocked;
+        imuThread = std::thread(&SenseHat::ImuWorker, this);
+    });
+    return imuReady;
+}
 
-          }
-      }
-      else
-      {
-        close(fbfd);
-        tries++;
-        usleep(100);
-        if (tries > NUMBER_OF_TRIES_BEFORE_FAILURE)
+/**
+ * @brief SenseHat::InitializeImu
+ * @details Runs on the IMU thread. Waits for the environmental sensors so
+ *          the RTIMULib settings are never used from two threads at once.
+ */
+bool SenseHat::InitializeImu(void)
+{
+    sensorsReady.wait();
+    if (!retry_backoff([this]
         {
-          printf("Error: cannot open framebuffer device.\n");
-          exit (EXIT_FAILURE);
+            if (imu != NULL) { delete imu; }
+            imu = RTIMU::createIMU(settings);
+            return imu != NULL && imu->IMUType() != RTIMU_TYPE_NULL;
+        }))
+    {
+        fprintf(stdout, "No IMU found\n");
+        return false;
+    }
+    imu->IMUInit();
+    imu->setSlerpPower(0.02);
+    imu->setGyroEnable(true);
+    imu->setAccelEnable(true);
+    imu->setCompassEnable(true);
+    return true;
+}
+
+void SenseHat::StopImu(void)
+{
+    imuStop = true;
+    if (imuThread.joinable()) { imuThread.join(); }
+}
+
+/**
+ * @brief SenseHat::ImuWorker
+ * @details Initializes the IMU, then drains it once per
+ *          IMUGetPollInterval(), on absolute deadlines, and publishes the
+ *          newest fused sample.
+ */
+void SenseHat::ImuWorker(void)
+{
+    struct timespec next;
+    ImuSample sample;
+    bool fresh;
+    int interval;
+
+    memset(&sample, 0, sizeof(sample));
+    if (!InitializeImu())
+    {
+        imuInit.set_value(false);
+        return;
+    }
+    imuStarted = std::chrono::steady_clock::now();
+    imuInit.set_value(true);
+    interval = imu->IMUGetPollInterval();
+    if (interval <= 0) { interval = 1; }
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!imuStop)
+    {
+        fresh = false;
+        while (imu->IMURead())
+        {
+            RTIMU_DATA imuData = imu->getIMUData();
+            sample.gyro[0] = imuData.gyro.x();
+            sample.gyro[1] = imuData.gyro.y();
+            sample.gyro[2] = imuData.gyro.z();
+            sample.accel[0] = imuData.accel.x();
+            sample.accel[1] = imuData.accel.y();
+            sample.accel[2] = imuData.accel.z();
+            sample.compass[0] = imuData.compass.x();
+            sample.compass[1] = imuData.compass.y();
+            sample.compass[2] = imuData.compass.z();
+            sample.pose[0] = imuData.fusionPose.x();
+            sample.pose[1] = imuData.fusionPose.y();
+            sample.pose[2] = imuData.fusionPose.z();
+            sample.timestamp = imuData.timestamp;
+            sample.valid = true;
+            fresh = true;
+        }
+        if (fresh) { PublishImu(sample); }
+        next.tv_nsec += interval * 1000000L;
+        while (next.tv_nsec >= 1000000000L)
+        {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
         }
-      }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+}
+#endif
 
+#if SENSEHAT_EMULATOR
+#else
+/**
+ * @brief  SenseHat::InitializeLeds
+ * @return false if the framebuffer never appeared or cannot be mapped
+ */
+bool SenseHat::InitializeLeds(void)
+{
+    if (!retry_backoff([this] { return MapLeds(); }))
+    {
+        printf("Error: cannot open framebuffer device.\n");
+        return false;
     }
+    return true;
+}
 
+/**
+ * @brief  SenseHat::MapLeds
+ * @details Maps the LED framebuffer, replacing a previous mapping, and
+ *          shows the last committed frame on it.
+ */
+bool SenseHat::MapLeds(void)
+{
+    struct fb_t *old;
+    int fbfd;
+    void *map;
+
+    fbfd = devices.OpenFramebuffer(LEDS_NAME);
+    if (fbfd < 0) { return false; }
+    map = mmap(0, sizeof(struct fb_t), PROT_READ | PROT_WRITE, MAP_SHARED, fbfd, 0);
+    close(fbfd);
+    if (map == MAP_FAILED)
+    {
+        printf("Failed to mmap.\n");
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(fbLock);
+    memcpy(map, &shown, sizeof(shown));
+    old = fb;
+    fb = (struct fb_t*)map;
+    if (old != NULL) { munmap(old, sizeof(struct fb_t)); }
+    return true;
 }
 
 /**
  * @brief  SenseHat::InitializeJoystick
  */
-void SenseHat::InitializeJoystick(void)
+bool SenseHat::InitializeJoystick(void)
 {
-	joystick = open_evdev("Raspberry Pi Sense HAT Joystick");
+	return retry_backoff([this] { return OpenJoystick(); });
 }
 
 /**
- * @brief  SenseHat::InitialiserPression
+ * @brief  SenseHat::OpenJoystick
+ * @details Opens the joystick and, if the input thread is running, hands
+ *          it the new descriptor.
  */
-void SenseHat::InitializePressure(void)
+bool SenseHat::OpenJoystick(void)
 {
-	int tries;
+	struct epoll_event ev;
+	int fd, ep;
+
+	fd = devices.OpenInput(JOYSTICK_NAME);
+	if (fd < 0) { return false; }
+	joystick = fd;
+	ep = joystickEpoll;
+	if (ep >= 0)
+	{
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+	}
+	return true;
+}
 
-	tries = 0;
-	while(true)
+/**
+ * @brief  SenseHat::HotplugWorker
+ * @details Sleeps on the device directory watch. When the framebuffer or
+ *          the joystick node it lost comes back, reopens it in place.
+ */
+void SenseHat::HotplugWorker(void)
+{
+	struct epoll_event ev[2];
+	int ep, wd, n, i, changed;
+
+	ledsReady.wait();
+	joystickReady.wait();
+	wd = devices.Watch();
+	if (wd < 0 || hotplugStop < 0) { return; }
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	if (ep < 0) { return; }
+	memset(ev, 0, sizeof(ev));
+	ev[0].events = EPOLLIN;
+	ev[0].data.fd = wd;
+	epoll_ctl(ep, EPOLL_CTL_ADD, wd, &ev[0]);
+	ev[0].data.fd = hotplugStop;
+	epoll_ctl(ep, EPOLL_CTL_ADD, hotplugStop, &ev[0]);
+	while (true)
 	{
-		pressure = RTPressure::createPressure(settings);
-		if (pressure == NULL)
+		n = epoll_wait(ep, ev, 2, -1);
+		if (n < 0)
 		{
-			tries++;
-			usleep(100);
+			if (errno == EINTR) { continue; }
+			break;
 		}
-		else
+		for (i = 0; i < n; i++)
 		{
-			break;
+			if (ev[i].data.fd == hotplugStop)
+			{
+				close(ep);
+				return;
+			}
 		}
-		if (tries > NUMBER_OF_TRIES_BEFORE_FAILURE)
+		changed = devices.ReadChanges();
+		if ((changed & DEVICE_FB_CHANGED) && devices.PathOf(LEDS_NAME).empty()) { MapLeds(); }
+		if ((changed & DEVICE_INPUT_CHANGED) && joystick < 0) { OpenJoystick(); }
+	}
+	close(ep);
+}
+
+void SenseHat::StopHotplug(void)
+{
+	uint64_t one = 1;
+
+	if (hotplugThread.joinable())
+	{
+		if (write(hotplugStop, &one, sizeof(one)) < 0) { return; }
+		hotplugThread.join();
+	}
+}
+
+/**
+ * @brief  SenseHat::InitializeSensors
+ * @details Pressure and humidity share the bus, so they come up in turn.
+ */
+bool SenseHat::InitializeSensors(void)
+{
+	bool pressureOk, humidityOk;
+
+	pressureOk = InitializePressure();
+	humidityOk = InitializeHumidity();
+	return pressureOk && humidityOk;
+}
+
+/**
+ * @brief  SenseHat::InitialiserPression
+ */
+bool SenseHat::InitializePressure(void)
+{
+	pressure = NULL;
+#if SENSEHAT_NATIVE_SENSORS
+	if (OpenI2c())
+	{
+		lps25h.reset(new Lps25h(*i2c));
+		if (lps25h->Init(LPS25H_ODR_25HZ, LPS25H_FIFO_MEAN, SENSEHAT_LPS25H_MEAN))
 		{
-			fprintf(stdout,"Pas de mesure de pression/température \n");
-			exit (EXIT_FAILURE);
+			return true;
 		}
+		lps25h.reset();
+	}
+#endif
+	if (!retry_backoff([this] { pressure = RTPressure::createPressure(settings); return pressure != NULL; }))
+	{
+		fprintf(stdout,"Pas de mesure de pression/température \n");
+		return false;
 	}
 	pressure->pressureInit();
+	return true;
 }
 
 /**
  * @brief  SenseHat::Initialiserhumidity
  * @detail initialise le capteur d'humidité
  */
-void SenseHat::InitializeHumidity(void)
+bool SenseHat::InitializeHumidity(void)
 {
-	int tries;
-
-	tries = 0;
-	while(true)
+	humidity = NULL;
+#if SENSEHAT_NATIVE_SENSORS
+	if (OpenI2c())
 	{
-		humidity = RTHumidity::createHumidity(settings);
-		if(humidity == NULL)
-		{
-			tries++;
-			usleep(100);
-		}
-		else
-		{
-			break;
-		}
-		if (tries > NUMBER_OF_TRIES_BEFORE_FAILURE)
+		hts221.reset(new Hts221(*i2c));
+		if (hts221->Init(HTS221_ODR_12HZ5, SENSEHAT_HTS221_AV_CONF))
 		{
-			fprintf(stdout,"Pas de mesure de pression/température \n");
-			exit (EXIT_FAILURE);
+			return true;
 		}
+		hts221.reset();
+	}
+#endif
+	if (!retry_backoff([this] { humidity = RTHumidity::createHumidity(settings); return humidity != NULL; }))
+	{
+		fprintf(stdout,"Pas de mesure d'humidité \n");
+		return false;
 	}
 	humidity->humidityInit();
+	return true;
+}
+
+/**
+ * @brief SenseHat::OpenI2c
+ * @details Opens the sensor bus once for both native drivers.
+ */
+bool SenseHat::OpenI2c(void)
+{
+	if (!i2c)
+	{
+		i2c.reset(new LinuxI2c(SENSEHAT_I2C_DEV));
+	}
+	return i2c->IsOpen();
+}
+
+/**
+ * @brief SenseHat::readPressure
+ * @details Reads the LPS25H through the native driver or RTIMULib; the
+ *          pressure is left untouched when it is not valid.
+ * @return false if the sensor could not be read
+ */
+bool SenseHat::readPressure(float &press, float &temperature)
+{
+	RTIMU_DATA data;
+
+	sensorsReady.wait();
+	if (lps25h)
+	{
+		return lps25h->Read(press, temperature);
+	}
+	if (pressure == NULL || !pressure->pressureRead(data))
+	{
+		return false;
+	}
+	temperature = data.temperature;
+	if (data.pressureValid)
+	{
+		press = data.pressure;
+	}
+	return true;
+}
+
+/**
+ * @brief SenseHat::readHumidity
+ * @details Reads the HTS221 through the native driver or RTIMULib; the
+ *          humidity is left untouched when it is not valid.
+ */
+bool SenseHat::readHumidity(float &humid)
+{
+	RTIMU_DATA data;
+	float temperature;
+
+	sensorsReady.wait();
+	if (hts221)
+	{
+		return hts221->Read(humid, temperature);
+	}
+	if (humidity == NULL || !humidity->humidityRead(data) || !data.humidityValid)
+	{
+		return false;
+	}
+	humid = data.humidity;
+	return true;
 }
 
 void SenseHat::InitializeOrientation(void)
@@ -864,141 +1498,342 @@ void SenseHat::InitializeAcceleration(void)
 
 /**
  * @brief  SenseHat::ConvertCharactereToPattern
+ * @details Expands a packed glyph to RGB565 without branches: each lit bit
+ *          selects colorText, each clear bit colorBackground.
  * - Fait par Grilo Christophe
  */
 void SenseHat::ConvertCharacterToPattern(char c, uint16_t image[8][8], uint16_t colorText, uint16_t colorBackground)
 {
-    int i=0;
+    uint64_t bits = glyphs.bits[(unsigned char)c];
+    uint16_t diff = colorText ^ colorBackground;
+    uint8_t row;
     int j,k;
-    int tailleTableDeConvertion=sizeof(font)/sizeof(Tfont);
 
-    // Recherche si le caractere existe dans la table de convertion (cf font.h)
-    while(c!=font[i].caractere && i < tailleTableDeConvertion )
-	i++;
+    for (j=0;j<8;j++)
+    {
+        row = (uint8_t)(bits >> (j*8));
+        for(k=0;k<8;k++)
+        {
+            image[j][k] = colorBackground ^ (diff & (uint16_t)-(int16_t)((row >> k) & 1));
+        }
+    }
+}
 
-    // Si le caractere est dans la table on le converti
-    if(i < tailleTableDeConvertion)
+/**
+ * @brief ScrollStrip::ScrollStrip
+ * @details Produces the columns of a message one at a time: the lit columns
+ *          of each glyph followed by one blank column, and SCROLL_SPACE_COLUMNS
+ *          blank columns for an empty glyph such as a space. Only the current
+ *          glyph is held, so memory does not grow with the message.
+ */
+ScrollStrip::ScrollStrip(const std::string &message) : text(message)
+{
+    pos = 0;
+    column = 0;
+    remaining = 0;
+    bits = 0;
+    window = 0;
+    blanks = 0;
+    primed = false;
+}
+
+/**
+ * @brief ScrollStrip::Next
+ * @param strip uint8_t receives the next column, bit n lit for row n
+ * @return false once the message is exhausted
+ */
+bool ScrollStrip::Next(uint8_t &strip)
+{
+    unsigned char c;
+    int row;
+
+    while (remaining == 0)
     {
-        for (j=0;j<8;j++)
+        if (pos >= text.length()) { return false; }
+        c = text[pos++];
+        if (c == 195 && pos < text.length())  // les lettres accentuées sont codées sur deux octets  (195 167 pour ç)
         {
-            for(k=0;k<8;k++)
-            {
-                if(font[i].binarypattern[j][k]) { image[j][k]=colorText; }
-                else { image[j][k]=colorBackground; }
-            }
+            c = text[pos++];
         }
+        bits = glyphs.bits[c];
+        column = glyphs.left[c];
+        remaining = glyphs.width[c] ? glyphs.width[c] + 1 : SCROLL_SPACE_COLUMNS;
+        if (glyphs.width[c] == 0) { bits = 0; }
     }
-    else // caractère inexistant on le remplace par un glyphe inconnu
-//	ConvertirCaractereEnpattern(255,image,colorText,colorBackground);
+    strip = 0;
+    if (column < 8)
     {
-        ConvertCharacterToPattern(255,image,colorText,colorBackground);
+        for (row = 0; row < 8; row++)
+        {
+            strip |= ((bits >> (row * 8 + column)) & 1) << row;
+        }
     }
+    column++;
+    remaining--;
+    return true;
 }
 
-bool SenseHat::EmptyColumn(int numcolumn,uint16_t image[8][8],uint16_t colorBackground)
+/**
+ * @brief ScrollStrip::Advance
+ * @param view uint64_t receives the 8 visible columns, byte k for column k
+ * @return false once the message has scrolled off the left edge
+ * @details Slides an 8-column window over the strip one column per call.
+ *          The window starts full, so the first view already shows the
+ *          start of the message. Each call costs the same whatever the
+ *          message length.
+ */
+bool ScrollStrip::Advance(uint64_t &view)
 {
-    int i=0;
+    uint8_t next;
+    int k;
 
-    for(i=0;i<8;i++)
+    if (!primed)
     {
-        if(image[i][numcolumn]!=colorBackground) { return false; }
+        for (k = 0; k < 8; k++)
+        {
+            if (!Next(next)) { next = 0; blanks++; }
+            window = (window >> 8) | ((uint64_t)next << 56);
+        }
+        primed = true;
     }
+    if (blanks >= 8) { return false; }
+    if (!Next(next)) { next = 0; blanks++; }
+    window = (window >> 8) | ((uint64_t)next << 56);
+    view = window;
     return true;
 }
 
-void SenseHat::ImageContainment(int numcolumn,uint16_t image[][8][8], int taille)
+/**
+ * @brief SenseHat::ViewMessage
+ * @details Scrolls the message and returns once it has left the matrix.
+ *          ShowMessage() does the same on the display thread.
+ */
+void SenseHat::ViewMessage(const std::string message, int vitesseDefilement, uint16_t colorText, uint16_t colorBackground)
+{
+    ScrollStrip strip(message);
+    uint64_t window;
+
+    while (strip.Advance(window))
+    {
+        usleep(1000*vitesseDefilement);
+        std::lock_guard<std::mutex> lock(displayLock);
+        ViewColumns(window, colorText, colorBackground);
+    }
+}
+
+/**
+ * @brief SenseHat::ViewColumns
+ * @param window uint64_t eight columns, byte k for column k, bit n for row n
+ * @details The caller holds displayLock.
+ */
+void SenseHat::ViewColumns(uint64_t window, uint16_t colorText, uint16_t colorBackground)
 {
-    int i=0,j=0,k=0,l=0,isuivant,ksuivant;
-    int nombredecolumns=taille*8; //8 columns par pattern
+    uint16_t image[8][8];
+    uint16_t diff = colorText ^ colorBackground;
+    int row, column;
 
-    for(l=numcolumn;l<nombredecolumns-1;l++)
+    for (row = 0; row < 8; row++)
     {
-        i=l/8;
-        k=l%8;
-        isuivant=(l+1)/8;
-        ksuivant=(l+1)%8;
-        for(j=0;j<8;j++)
+        for (column = 0; column < 8; column++)
         {
-            image[i][j][k]=image[isuivant][j][ksuivant];
+            image[row][column] = colorBackground ^ (diff & (uint16_t)-(int16_t)((window >> (column * 8 + row)) & 1));
         }
     }
+    DrawPattern(image);
 }
 
-void SenseHat::ViewMessage(const std::string message, int vitesseDefilement, uint16_t colorText, uint16_t colorBackground)
+/**
+ * @brief SenseHat::ShowMessage
+ * @details Queues a scrolling message for the display thread and returns at
+ *          once. A higher priority job preempts it between two columns; it
+ *          resumes where it stopped once the higher priority job is done.
+ */
+void SenseHat::ShowMessage(const std::string &message, int priority, int vitesseDefilement, uint16_t colorText, uint16_t colorBackground)
 {
-    int taille=message.length();
-    uint16_t chaine[taille][8][8]; /* Le tableau de pattern (image/caractère) à afficher */
-    int i=0,j=0,k=0,l=0,nombreDecolumnVide=0;
-    int isuivant=0,ksuivant=0,nombreDecolumns=0;
+    std::unique_ptr<DisplayJob> job(new DisplayJob);
+
+    job->kind = DISPLAY_JOB_SCROLL;
+    job->priority = priority;
+    job->period = vitesseDefilement;
+    job->colorText = colorText;
+    job->colorBackground = colorBackground;
+    job->message = message;
+    job->strip.reset(new ScrollStrip(job->message));
+    QueueJob(std::move(job));
+}
+
+/**
+ * @brief SenseHat::ShowPattern
+ * @details Queues one 8x8 pattern to stay on the matrix for duration ms.
+ */
+void SenseHat::ShowPattern(uint16_t pattern[][8], int priority, int duration)
+{
+    std::vector<fb_t> frames(1);
+
+    memcpy(frames[0].pixel, pattern, sizeof(frames[0].pixel));
+    ShowAnimation(frames, duration, priority);
+}
 
-    /* Convertion de tout le message en tableau de patterns
-     * format caractère : 1 column vide + 5 columns réellement utilisées
-     * + 2 columns vides */
-    for( i=0,j=0; i<taille; i++,j++)
+/**
+ * @brief SenseHat::ShowAnimation
+ * @details Queues a sequence of frames, each shown for period ms.
+ */
+void SenseHat::ShowAnimation(const std::vector<fb_t> &frames, int period, int priority)
+{
+    std::unique_ptr<DisplayJob> job(new DisplayJob);
+
+    if (frames.empty()) { return; }
+    job->kind = DISPLAY_JOB_FRAMES;
+    job->priority = priority;
+    job->period = period;
+    job->frames = frames;
+    job->frame = 0;
+    QueueJob(std::move(job));
+}
+
+/**
+ * @brief SenseHat::SetIdlePattern
+ * @details The pattern the display thread shows whenever no job is running.
+ */
+void SenseHat::SetIdlePattern(uint16_t pattern[][8])
+{
+    StartDisplay();
+    std::lock_guard<std::mutex> lock(displayLock);
+    memcpy(idle.pixel, pattern, sizeof(idle.pixel));
+    idleSet = true;
+    idleDirty = true;
+    displayWake.notify_one();
+}
+
+void SenseHat::QueueJob(std::unique_ptr<DisplayJob> job)
+{
+    StartDisplay();
+    std::lock_guard<std::mutex> lock(displayLock);
+    job->order = displayOrder++;
+    displayJobs.push_back(std::move(job));
+    displayWake.notify_one();
+}
+
+void SenseHat::StartDisplay(void)
+{
+    std::call_once(displayOnce, [this]
     {
-        if(message[i]==195)  // les lettres accentuées sont codées sur deux octets  (195 167 pour ç)
+        SignalsBlocked blocked;
+        displayThread = std::thread(&SenseHat::DisplayWorker, this);
+    });
+}
+
+void SenseHat::StopDisplay(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(displayLock);
+        displayStop = true;
+        displayWake.notify_one();
+    }
+    if (displayThread.joinable()) { displayThread.join(); }
+}
+
+/**
+ * @brief SenseHat::PreemptingJob
+ * @return true if a queued job outranks priority (caller holds displayLock)
+ */
+bool SenseHat::PreemptingJob(int priority)
+{
+    for (size_t i = 0; i < displayJobs.size(); i++)
+    {
+        if (displayJobs[i]->priority > priority) { return true; }
+    }
+    return false;
+}
+
+/**
+ * @brief SenseHat::PopJob
+ * @return the highest priority job, oldest first (caller holds displayLock)
+ */
+std::unique_ptr<DisplayJob> SenseHat::PopJob(void)
+{
+    std::unique_ptr<DisplayJob> job;
+    size_t best = 0;
+
+    if (displayJobs.empty()) { return job; }
+    for (size_t i = 1; i < displayJobs.size(); i++)
+    {
+        if (displayJobs[i]->priority > displayJobs[best]->priority
+            || (displayJobs[i]->priority == displayJobs[best]->priority && displayJobs[i]->order < displayJobs[best]->order))
         {
-            i++;
-            k++;
+            best = i;
         }
-  	// row suivante à décommenter pour obtenir le code des caractères UTF8
-	// std::cout << "code : " << (int)message[i] << std::endl;
-		ConvertCharacterToPattern(message[i],chaine[j],colorText,colorBackground);
     }
-	taille = taille - k;
-	nombreDecolumns=(taille)*8-2;
-	k = 0;
-	// Parcours de toutes les columns de tous les patterns qui compose
-	// la chaine de caractères à afficher pour supprimer les columns vides sauf celle
-	// qui sépare les patterns (caractères). + gestion du caractère espace.
-	for( l=0;l<nombreDecolumns;l++)
-	{
-		i=l/8;
-		k=l%8;
+    job = std::move(displayJobs[best]);
+    displayJobs.erase(displayJobs.begin() + best);
+    return job;
+}
 
-//		if(columnVide(k,chaine[i],colorBackground)) // Une column Vide avant chaque caractère à ne pas supprimer
-		if(EmptyColumn(k,chaine[i],colorBackground)) // Une column Vide avant chaque caractère à ne pas supprimer
-		{
-			isuivant=(++l)/8;
-			ksuivant=(l)%8;
-			nombreDecolumnVide=1;
-
-			// compter les columns vide après la première afin de les supprimer
-			// si plus de 4 c'est le caractère espace que l'on doit garder
-//			while(columnVide(ksuivant,chaine[isuivant],colorBackground) && nombreDecolumnVide++ < 6)
-			while(EmptyColumn(ksuivant,chaine[isuivant],colorBackground) && nombreDecolumnVide++ < 6)
-			{
-				ImageContainment(l,chaine,taille);
-				nombreDecolumns--;
-			}
+/**
+ * @brief SenseHat::StepJob
+ * @return false once the job has nothing more to show (caller holds displayLock)
+ */
+bool SenseHat::StepJob(DisplayJob &job)
+{
+    uint64_t window;
 
-		}
-	}
+    if (job.kind == DISPLAY_JOB_SCROLL)
+    {
+        if (!job.strip->Advance(window)) { return false; }
+        ViewColumns(window, job.colorText, job.colorBackground);
+        return true;
+    }
+    if (job.frame >= job.frames.size()) { return false; }
+    DrawPattern(job.frames[job.frame++].pixel);
+    return true;
+}
 
-	// Parcours de toutes les columns de tous les patterns qui composent
-	// la chaine de caractères à afficher (sans les columns vides superflues).
-	for( l=0; l<nombreDecolumns; l++)
-	{
-		// Decalage des columns vers la gauche sur l'image Numero 0 (celle qu'on affiche sur la matrice de LED
-		for( i=0;i<taille;i++)
-		{
-			// Cas Normal, les columns sont sur le même pattern
-			for(j=0;j<8;j++)
-			{
-				for(k=0;k<7;k++)
-					chaine[i][j][k]=chaine[i][j][k+1];
+/**
+ * @brief SenseHat::DisplayWorker
+ * @details Owns the matrix while it runs. Frames are paced against absolute
+ *          steady_clock deadlines, so drawing time does not stretch a scroll,
+ *          and the wait ends early when a higher priority job is queued.
+ */
+void SenseHat::DisplayWorker(void)
+{
+    std::unique_lock<std::mutex> lock(displayLock);
+    std::unique_ptr<DisplayJob> current;
+    std::chrono::steady_clock::time_point deadline;
 
-			}
-			// Cas où l'on doit changer de pattern
-			for(j=0;j<8;j++)
-			{
-				chaine[i][j][7]=chaine[i+1][j][0];
+    while (!displayStop)
+    {
+        if (!current)
+        {
+            current = PopJob();
+            if (!current)
+            {
+                if (idleSet && idleDirty)
+                {
+                    DrawPattern(idle.pixel);
+                    idleDirty = false;
+                }
+                displayWake.wait(lock, [this] { return displayStop || !displayJobs.empty() || idleDirty; });
+                continue;
             }
-		}
-		usleep(1000*vitesseDefilement);
-		ViewPattern(chaine[0]);
-	}
-
+            deadline = std::chrono::steady_clock::now();
+        }
+        if (PreemptingJob(current->priority))
+        {
+            displayJobs.push_back(std::move(current));
+            continue;
+        }
+        if (displayWake.wait_until(lock, deadline, [&] { return displayStop || PreemptingJob(current->priority); }))
+        {
+            continue;
+        }
+        if (!StepJob(*current))
+        {
+            current.reset();
+            idleDirty = true;
+            continue;
+        }
+        deadline += std::chrono::milliseconds(current->period);
+    }
 }
 
 SenseHat& SenseHat::operator<<(const std::string &message)
@@ -1038,11 +1873,11 @@ SenseHat& SenseHat::operator<<(const bool valeur)
 	buffer +=  std::to_string(valeur);
 	return *this;
 }
-// Méthode Flush() Affiche le buffer puis le vide
+// Méthode Flush() Affiche le buffer puis le vide, sans attendre la fin du défilement
 void SenseHat::Flush(void)
 {
 	buffer += "  ";
-	ViewMessage(buffer, 80, color);
+	ShowMessage(buffer, DISPLAY_PRIORITY_NORMAL, 80, color);
 	buffer = " ";
 }
 
@@ -31,6 +31,20 @@
 #include <RTIMULib.h>
 #include <iostream>
 #include <iomanip>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "lps25h.h"
+#include "hts221.h"
+#include "devices.h"
 
 // Constants
 #define SENSEHAT_EMULATOR 0
@@ -38,9 +52,10 @@
 #include <python2.7/Python.h>
 #endif
 #define DEV_FB "/dev"
-#define FB_DEV_NAME "fb"
 #define DEV_INPUT_EVENT "/dev/input"
-#define EVENT_DEV_NAME "event"
+#define DEVICE_CACHE_PATH "sensehat.dev"
+#define LEDS_NAME "RPi-Sense FB"
+#define JOYSTICK_NAME "Raspberry Pi Sense HAT Joystick"
 
 #define COLOR_SENSEHAT uint16_t
 #define PI 3.14159265
@@ -55,14 +70,114 @@
 #define MAGENTA 0xF81F
 #define YELLOW  0xFFE0
 
+#define SCROLL_SPACE_COLUMNS 3
+
+#define DISPLAY_PRIORITY_BACKGROUND 0
+#define DISPLAY_PRIORITY_NORMAL 1
+#define DISPLAY_PRIORITY_ALERT 2
+#define DISPLAY_JOB_SCROLL 0
+#define DISPLAY_JOB_FRAMES 1
+
+#define JOYSTICK_RELEASE 0
+#define JOYSTICK_PRESS 1
+#define JOYSTICK_REPEAT 2
+#define JOYSTICK_LONGPRESS 3
+#define JOYSTICK_LONGPRESS_MS 700
+#define JOYSTICK_QUEUE 64
+#define JOYSTICK_BURST 16
+
+#define IMU_FIRST_SAMPLE_MS 100
+
+#define CPU_TEMP_PATH "/sys/class/thermal/thermal_zone0/temp"
+#define CPU_TEMP_PERIOD_MS 1000
+#define CPU_TEMP_ALPHA 0.2f
+#define SYSFS_BUFSZ 32
+
+// Drive the LPS25H/HTS221 directly, falling back to RTIMULib if they fail
+#define SENSEHAT_NATIVE_SENSORS 1
+#define SENSEHAT_I2C_DEV "/dev/i2c-1"
+#define SENSEHAT_LPS25H_MEAN 8
+#define SENSEHAT_HTS221_AV_CONF (HTS221_AVGT_16 | HTS221_AVGH_32)
+
 // Structures
 struct fb_t
 {
 	uint16_t pixel[8][8];
 };
 
+struct EnvSample
+{
+	time_t rtime;           // wall clock, seconds
+	uint64_t mtime;         // CLOCK_MONOTONIC, nanoseconds
+	float temperature;      // corrected for CPU heat
+	float rawTemperature;
+	float cpuTemperature;
+	float pressure;
+	float humidity;
+};
+
+struct ImuSample
+{
+	float gyro[3];
+	float accel[3];
+	float compass[3];
+	float pose[3];      // fusion roll, pitch, yaw in radians
+	uint64_t timestamp; // RTIMULib timestamp, microseconds
+	bool valid;
+};
+
+struct JoystickEvent
+{
+	uint16_t code;      // KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT, KEY_ENTER
+	uint8_t type;       // JOYSTICK_PRESS, _RELEASE, _REPEAT or _LONGPRESS
+	uint64_t time;      // CLOCK_MONOTONIC milliseconds
+};
+
 
 // Classes
+class ScrollStrip
+{
+public:
+    ScrollStrip(const std::string &message);
+    bool Next(uint8_t &strip);
+    bool Advance(uint64_t &view);
+
+private:
+    const std::string &text;
+    size_t pos;
+    int column;
+    int remaining;
+    uint64_t bits;
+    uint64_t window;
+    int blanks;
+    bool primed;
+};
+
+class SysfsReader
+{
+public:
+    SysfsReader(const char *path);
+    ~SysfsReader(void);
+    bool ReadInt(long &value);
+
+private:
+    int fd;
+};
+
+struct DisplayJob
+{
+    int kind;
+    int priority;
+    uint64_t order;
+    int period;
+    uint16_t colorText;
+    uint16_t colorBackground;
+    std::string message;
+    std::unique_ptr<ScrollStrip> strip;
+    std::vector<fb_t> frames;
+    size_t frame;
+};
+
 class SenseHat
 {
 public:
@@ -79,6 +194,10 @@ public:
 
 
 	void ViewMessage(const std::string message, int vitesseDefilement = 100, uint16_t colorText = BLUE, uint16_t colorBackground = BLACK);
+	void ShowMessage(const std::string &message, int priority = DISPLAY_PRIORITY_NORMAL, int vitesseDefilement = 100, uint16_t colorText = BLUE, uint16_t colorBackground = BLACK);
+	void ShowPattern(uint16_t pattern[][8], int priority = DISPLAY_PRIORITY_NORMAL, int duration = 1000);
+	void ShowAnimation(const std::vector<fb_t> &frames, int period, int priority = DISPLAY_PRIORITY_NORMAL);
+	void SetIdlePattern(uint16_t pattern[][8]);
 	void ViewLetter(char lettre, uint16_t colorText = BLUE, uint16_t colorBackground = BLACK);
 	void LightPixel(int row, int column, uint16_t color);
 	uint16_t GetPixel(int row, int column);
@@ -86,20 +205,35 @@ public:
 	void RotatePattern(int rotation);
     char ScannerJoystick(void);
     char ScanJoystick(void);
+    int  JoystickFd(void);
+    bool ReadJoystick(JoystickEvent &ev);
+    void SetJoystickCallback(std::function<void(const JoystickEvent &)> callback);
     COLOR_SENSEHAT ConvertRGB565(uint8_t red, uint8_t green,uint8_t blue);
 	COLOR_SENSEHAT ConvertRGB565(uint8_t color[]);
 	COLOR_SENSEHAT ConvertRGB565(std::string color);
 	void WipeScreen(uint16_t color=BLACK);
+	void BeginFrame(void);
+	void Present(void);
+	std::shared_future<bool> LedsReady(void) { return ledsReady; }
+	std::shared_future<bool> JoystickReady(void) { return joystickReady; }
+	std::shared_future<bool> SensorsReady(void) { return sensorsReady; }
+	EnvSample ReadEnvironment(void);
 	float GetTemperature(void);
 	float correctTemperature(float senseHatTemp, float cpuTemp);
 	float getRawTemperature(void);
 	float getCpuTemperature(void);
+	float sampleCpuTemperature(void);
 	float GetPressure(void);
 	float GetHumidity(void);
 	void  GetOrientation(float &pitch, float &roll, float & yaw);
 	void  GetAcceleration(float &x, float &y, float &z);
 	void  GetMagnetism(float &x, float &y, float &z);
 	void  GetSphericalMagnetism(float &ro, float &teta, float &delta);
+#if SENSEHAT_EMULATOR
+#else
+	bool  GetImuSample(ImuSample &sample);
+	std::shared_future<bool> ImuReady(void);
+#endif
     void  Version(void);
     void  Flush(void);
 	void  SetColor(uint16_t);
@@ -108,29 +242,112 @@ public:
 private:
 #if SENSEHAT_EMULATOR
 #else
-	void  InitializeLeds(void);
-	void  InitializeJoystick(void);
-	void  InitializePressure(void);
-	void  InitializeHumidity(void);
+	bool  InitializeLeds(void);
+	bool  MapLeds(void);
+	bool  InitializeJoystick(void);
+	bool  OpenJoystick(void);
+	void  HotplugWorker(void);
+	void  StopHotplug(void);
+	bool  InitializeSensors(void);
+	bool  InitializePressure(void);
+	bool  InitializeHumidity(void);
+	bool  InitializeImu(void);
 	void  InitializeOrientation(void);
 	void  InitializeAcceleration(void);
+	bool  OpenI2c(void);
+	bool  readPressure(float &press, float &temperature);
+	bool  readHumidity(float &humid);
 #endif
 	void ConvertCharacterToPattern(char c, uint16_t image[8][8], uint16_t colorText, uint16_t colorBackground);
-	bool EmptyColumn(int numcolumn, uint16_t image[8][8], uint16_t colorBackground);
-	void ImageContainment(int numcolumn, uint16_t image[][8][8], int taille);
+	void DrawPattern(uint16_t pattern[][8]);
+	void ViewColumns(uint64_t window, uint16_t colorText, uint16_t colorBackground);
+	void Commit(void);
+	void QueueJob(std::unique_ptr<DisplayJob> job);
+	void StartDisplay(void);
+	void StopDisplay(void);
+	bool PreemptingJob(int priority);
+	std::unique_ptr<DisplayJob> PopJob(void);
+	bool StepJob(DisplayJob &job);
+	void DisplayWorker(void);
+	void StartCpuTemperature(void);
+	void StopCpuTemperature(void);
+	void CpuTemperatureWorker(void);
+	void StartJoystick(void);
+	void StopJoystick(void);
+	void PublishJoystick(uint16_t code, uint8_t type, uint64_t time);
+	void JoystickWorker(void);
+#if SENSEHAT_EMULATOR
+#else
+	void StopImu(void);
+	void PublishImu(const ImuSample &sample);
+	void ImuWorker(void);
+#endif
 
+    std::shared_future<bool> ledsReady;
+    std::shared_future<bool> joystickReady;
+    std::shared_future<bool> sensorsReady;
+    DeviceRegistry devices;
+    std::thread hotplugThread;
+    int hotplugStop;
+    std::mutex fbLock;
     struct fb_t *fb;
-    int joystick;
+    struct fb_t back;
+    struct fb_t shown;
+    int frameDepth;
+    std::atomic<int> joystick;
+    std::atomic<int> joystickEpoll;
 #if SENSEHAT_EMULATOR
 #else
     RTIMUSettings *settings;
     RTIMU *imu;
     RTPressure *pressure;
     RTHumidity *humidity;
+    std::unique_ptr<LinuxI2c> i2c;
+    std::unique_ptr<Lps25h> lps25h;
+    std::unique_ptr<Hts221> hts221;
 #endif
     std::string buffer;
     uint16_t color;
     int rotation;
+
+    std::thread displayThread;
+    std::once_flag displayOnce;
+    std::mutex displayLock;
+    std::condition_variable displayWake;
+    std::vector<std::unique_ptr<DisplayJob> > displayJobs;
+    uint64_t displayOrder;
+    bool displayStop;
+    struct fb_t idle;
+    bool idleSet;
+    bool idleDirty;
+
+    std::thread joystickThread;
+    std::once_flag joystickOnce;
+    std::mutex joystickLock;
+    std::function<void(const JoystickEvent &)> joystickCallback;
+    int joystickStop;
+    int joystickNotify;
+    std::atomic<uint32_t> joystickHead;
+    std::atomic<uint32_t> joystickTail;
+    std::atomic<uint32_t> joystickDropped;
+    JoystickEvent joystickQueue[JOYSTICK_QUEUE];
+
+    std::thread imuThread;
+    std::once_flag imuOnce;
+    std::promise<bool> imuInit;
+    std::shared_future<bool> imuReady;
+    std::atomic<bool> imuStop;
+    std::chrono::steady_clock::time_point imuStarted;
+    std::atomic<uint32_t> imuSeq;
+    ImuSample imuSample;
+
+    SysfsReader cpuTempFile;
+    std::thread cpuThread;
+    std::once_flag cpuOnce;
+    std::mutex cpuLock;
+    std::condition_variable cpuWake;
+    bool cpuStop;
+    std::atomic<float> cpuTemperature;
 };
 
 // surcharge des manipulators
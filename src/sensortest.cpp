@@ -0,0 +1,220 @@
+/**
+ * @file sensortest.cpp
+ * @details sensortest: checks the LPS25H and HTS221 drivers against a
+ *          FakeI2c register map, so it runs without a Sense HAT. Prints
+ *          each failed check and exits non-zero if there was one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "i2cbus.h"
+#include "hts221.h"
+#include "lps25h.h"
+
+#define CHECK(cond) Check((cond), #cond, __LINE__)
+#define NEAR(a, b) (fabsf((a) - (b)) < 0.001f)
+
+static int failures;
+
+static void Check(bool ok, const char *what, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "sensortest.cpp:%d: %s\n", line, what);
+        failures++;
+    }
+}
+
+/**
+ * @brief Lps25hFrame
+ * @details Encodes one output frame, PRESS_OUT_XL through TEMP_OUT_H.
+ */
+static void Lps25hFrame(uint8_t *frame, float pressure, float temperature)
+{
+    int32_t p;
+    int16_t t;
+
+    p = (int32_t)lroundf(pressure * 4096.0f);
+    t = (int16_t)lroundf((temperature - 42.5f) * 480.0f);
+    frame[0] = p & 0xFF;
+    frame[1] = (p >> 8) & 0xFF;
+    frame[2] = (p >> 16) & 0xFF;
+    frame[3] = t & 0xFF;
+    frame[4] = (t >> 8) & 0xFF;
+}
+
+static void TestLps25h(void)
+{
+    FakeI2c bus;
+    Lps25h lps(bus);
+    uint8_t frame[LPS25H_FRAME];
+    float p, t;
+    int i;
+
+    CHECK(!lps.Init(LPS25H_ODR_25HZ, LPS25H_FIFO_MEAN, 32));
+    bus.Set(LPS25H_ADDRESS, LPS25H_WHO_AM_I, LPS25H_ID);
+    CHECK(lps.Init(LPS25H_ODR_25HZ, LPS25H_FIFO_MEAN, 32));
+    CHECK(bus.Get(LPS25H_ADDRESS, LPS25H_RES_CONF) == LPS25H_RES_CONF_MEAN);
+    CHECK(bus.Get(LPS25H_ADDRESS, LPS25H_FIFO_CTRL) == (LPS25H_FIFO_MEAN | 31));
+    CHECK(bus.Get(LPS25H_ADDRESS, LPS25H_CTRL_REG2) == LPS25H_FIFO_EN);
+    CHECK(bus.Get(LPS25H_ADDRESS, LPS25H_CTRL_REG1) == (LPS25H_PD | LPS25H_BDU | LPS25H_ODR_25HZ));
+
+    // Nothing converted yet
+    CHECK(!lps.Read(p, t));
+    Lps25hFrame(frame, 1013.25f, 25.0f);
+    for (i = 0; i < LPS25H_FRAME; i++)
+    {
+        bus.Set(LPS25H_ADDRESS, LPS25H_PRESS_OUT_XL + i, frame[i]);
+    }
+    bus.Set(LPS25H_ADDRESS, LPS25H_STATUS_REG, LPS25H_P_DA | LPS25H_T_DA);
+    CHECK(lps.Read(p, t));
+    CHECK(NEAR(p, 1013.25f));
+    CHECK(NEAR(t, 25.0f));
+    // Below 42.5 C the temperature word is negative
+    Lps25hFrame(frame, 980.5f, -5.0f);
+    for (i = 0; i < LPS25H_FRAME; i++)
+    {
+        bus.Set(LPS25H_ADDRESS, LPS25H_PRESS_OUT_XL + i, frame[i]);
+    }
+    CHECK(lps.Read(p, t));
+    CHECK(NEAR(p, 980.5f));
+    CHECK(NEAR(t, -5.0f));
+    // No new conversion: the previous values stand
+    bus.Set(LPS25H_ADDRESS, LPS25H_STATUS_REG, 0);
+    bus.Set(LPS25H_ADDRESS, LPS25H_PRESS_OUT_XL, 0xFF);
+    CHECK(lps.Read(p, t));
+    CHECK(NEAR(p, 980.5f));
+
+    // Mean samples are clamped to the FIFO depth
+    CHECK(lps.Init(LPS25H_ODR_25HZ, LPS25H_FIFO_MEAN, 64, 0));
+    CHECK(bus.Get(LPS25H_ADDRESS, LPS25H_FIFO_CTRL) == (LPS25H_FIFO_MEAN | 31));
+    CHECK(bus.Get(LPS25H_ADDRESS, LPS25H_RES_CONF) == 0);
+}
+
+static void TestLps25hDrain(void)
+{
+    FakeI2c bus;
+    Lps25h lps(bus);
+    uint8_t frame[LPS25H_FRAME];
+    float p[LPS25H_FIFO_DEPTH], t[LPS25H_FIFO_DEPTH];
+    unsigned reads;
+    int i, n;
+
+    bus.Set(LPS25H_ADDRESS, LPS25H_WHO_AM_I, LPS25H_ID);
+    CHECK(lps.Init(LPS25H_ODR_25HZ, LPS25H_FIFO_STREAM, 2));
+    CHECK(bus.Get(LPS25H_ADDRESS, LPS25H_FIFO_CTRL) == (LPS25H_FIFO_STREAM | 1));
+    CHECK(bus.Get(LPS25H_ADDRESS, LPS25H_CTRL_REG2) == LPS25H_FIFO_EN);
+
+    // An empty FIFO yields nothing
+    bus.Set(LPS25H_ADDRESS, LPS25H_FIFO_STATUS, LPS25H_FIFO_EMPTY);
+    CHECK(lps.Drain(p, t, LPS25H_FIFO_DEPTH) == 0);
+
+    for (i = 0; i < 3; i++)
+    {
+        Lps25hFrame(frame, 1000.0f + i, 20.0f + i);
+        bus.PushFifo(LPS25H_ADDRESS, LPS25H_PRESS_OUT_XL, frame, sizeof(frame));
+    }
+    bus.Set(LPS25H_ADDRESS, LPS25H_FIFO_STATUS, 3);
+    reads = bus.reads;
+    n = lps.Drain(p, t, LPS25H_FIFO_DEPTH);
+    CHECK(n == 3);
+    // The status, then every frame in one burst
+    CHECK(bus.reads - reads == 2);
+    for (i = 0; i < n; i++)
+    {
+        CHECK(NEAR(p[i], 1000.0f + i));
+        CHECK(NEAR(t[i], 20.0f + i));
+    }
+
+    // A full FIFO is drained up to max; the rest waits for the next call
+    for (i = 0; i < LPS25H_FIFO_DEPTH; i++)
+    {
+        Lps25hFrame(frame, 900.0f + i, 10.0f);
+        bus.PushFifo(LPS25H_ADDRESS, LPS25H_PRESS_OUT_XL, frame, sizeof(frame));
+    }
+    bus.Set(LPS25H_ADDRESS, LPS25H_FIFO_STATUS, LPS25H_FIFO_FULL);
+    CHECK(lps.Drain(p, t, 8) == 8);
+    CHECK(NEAR(p[0], 900.0f) && NEAR(p[7], 907.0f));
+    bus.Set(LPS25H_ADDRESS, LPS25H_FIFO_STATUS, LPS25H_FIFO_DEPTH - 8);
+    CHECK(lps.Drain(p, t, LPS25H_FIFO_DEPTH) == LPS25H_FIFO_DEPTH - 8);
+    CHECK(NEAR(p[0], 908.0f) && NEAR(p[LPS25H_FIFO_DEPTH - 9], 931.0f));
+
+    // Outside stream mode Drain() is a single Read()
+    CHECK(lps.Init(LPS25H_ODR_25HZ, LPS25H_FIFO_MEAN, 32));
+    Lps25hFrame(frame, 1010.0f, 22.0f);
+    for (i = 0; i < LPS25H_FRAME; i++)
+    {
+        bus.Set(LPS25H_ADDRESS, LPS25H_PRESS_OUT_XL + i, frame[i]);
+    }
+    bus.Set(LPS25H_ADDRESS, LPS25H_STATUS_REG, LPS25H_P_DA);
+    CHECK(lps.Drain(p, t, LPS25H_FIFO_DEPTH) == 1);
+    CHECK(NEAR(p[0], 1010.0f) && NEAR(t[0], 22.0f));
+}
+
+static void TestHts221(void)
+{
+    FakeI2c bus;
+    Hts221 hts(bus);
+    uint8_t calib[HTS221_CALIB_SZ] =
+    {
+        40, 160,        // H0_rH_x2 20 %, H1_rH_x2 80 %
+        80, 0x40,       // T0_degC_x8 10 C, T1_degC_x8 low byte
+        0, 0x04,        // T1 bit 8 set: T1_degC_x8 320, 40 C
+        0x00, 0x00,     // H0_T0_OUT 0
+        0, 0,
+        0x70, 0x17,     // H1_T0_OUT 6000
+        100, 0,         // T0_OUT 100
+        0x4C, 0x04      // T1_OUT 1100
+    };
+    float h, t;
+    int i;
+
+    CHECK(!hts.Init(HTS221_ODR_12HZ5, HTS221_AVGT_16 | HTS221_AVGH_32));
+    bus.Set(HTS221_ADDRESS, HTS221_WHO_AM_I, HTS221_ID);
+    // All-zero calibration can't be interpolated
+    CHECK(!hts.Init(HTS221_ODR_12HZ5, HTS221_AVGT_16 | HTS221_AVGH_32));
+    for (i = 0; i < HTS221_CALIB_SZ; i++)
+    {
+        bus.Set(HTS221_ADDRESS, HTS221_CALIB + i, calib[i]);
+    }
+    CHECK(hts.Init(HTS221_ODR_12HZ5, HTS221_AVGT_16 | HTS221_AVGH_32));
+    CHECK(bus.Get(HTS221_ADDRESS, HTS221_AV_CONF) == (HTS221_AVGT_16 | HTS221_AVGH_32));
+    CHECK(bus.Get(HTS221_ADDRESS, HTS221_CTRL_REG1) == (HTS221_PD | HTS221_BDU | HTS221_ODR_12HZ5));
+
+    CHECK(!hts.Read(h, t));
+    // H_OUT 3000, T_OUT 600
+    bus.Set(HTS221_ADDRESS, HTS221_HUMIDITY_OUT_L, 0xB8);
+    bus.Set(HTS221_ADDRESS, HTS221_HUMIDITY_OUT_L + 1, 0x0B);
+    bus.Set(HTS221_ADDRESS, HTS221_HUMIDITY_OUT_L + 2, 0x58);
+    bus.Set(HTS221_ADDRESS, HTS221_HUMIDITY_OUT_L + 3, 0x02);
+    // Humidity alone is not a complete sample
+    bus.Set(HTS221_ADDRESS, HTS221_STATUS_REG, HTS221_H_DA);
+    CHECK(!hts.Read(h, t));
+    bus.Set(HTS221_ADDRESS, HTS221_STATUS_REG, HTS221_H_DA | HTS221_T_DA);
+    CHECK(hts.Read(h, t));
+    CHECK(NEAR(h, 50.0f));
+    CHECK(NEAR(t, 25.0f));
+    // Interpolation past the calibration points is clamped to 0..100 %
+    bus.Set(HTS221_ADDRESS, HTS221_HUMIDITY_OUT_L, 0x30);
+    bus.Set(HTS221_ADDRESS, HTS221_HUMIDITY_OUT_L + 1, 0x75);
+    CHECK(hts.Read(h, t));
+    CHECK(NEAR(h, 100.0f));
+    bus.Set(HTS221_ADDRESS, HTS221_HUMIDITY_OUT_L, 0x48);
+    bus.Set(HTS221_ADDRESS, HTS221_HUMIDITY_OUT_L + 1, 0xF4);
+    CHECK(hts.Read(h, t));
+    CHECK(NEAR(h, 0.0f));
+}
+
+int main(void)
+{
+    TestLps25h();
+    TestLps25hDrain();
+    TestHts221();
+    if (failures > 0)
+    {
+        fprintf(stderr, "sensortest: %d failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    fprintf(stdout, "sensortest: ok\n");
+    return EXIT_SUCCESS;
+}